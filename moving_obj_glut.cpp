@@ -7,6 +7,29 @@
 #include <iomanip>
 #include <cstdlib>
 #include <ctime>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+#include <new>
+#include <filesystem>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
+#endif
 
 using namespace std;
 
@@ -16,45 +39,248 @@ const unsigned int SCR_HEIGHT = 900;
 const float PI = 3.14159265359f;
 
 
-float angleAll = 0.0f;
-float moonAngle = 0.0f;
-int currentFrame = 1;
-int zoomPlanetIndex = -1;
-bool isPaused = false;
-float transitionFactor = 0.0f;
-float currentCamX = 0, currentCamY = 0, currentZoom = 1.0f;
-float starScroll = 0;
-float meteorX = -1.0f, meteorY = 0.8f;
-bool showMeteor = false;
-float speedMultiplier = 1.0f;
-bool showHelp = false;
-float sunPulse = 0.0f;
+struct SimState {
+    long long tick;
+    double time, angleAll;
+    double planetRotation[8];
+    float effectTime, sunPulse, coronaAngle, heatwavePhase, cloudAngle;
+    float ringAngle[8];
+    float cometX, aircraftX, starScroll;
+};
 
+struct Body {
+    float x, y, radius;
+    int kind, index, parent;
+    bool visible;
+};
 
-float planetRotation[8] = {0};
-float planetRotationSpeeds[] = {0.5f, 0.3f, 1.0f, 0.9f, 2.5f, 2.2f, 1.5f, 1.6f};
+// Orbital hierarchy (sun -> planet -> moon, earth view -> satellites) as flat arrays ordered
+// parents first, so world positions resolve in one linear pass over the nodes that moved.
+struct TransformGraph {
+    vector<int> parent;
+    vector<float> orbit, rate, phase, radius;
+    vector<float> angle, localX, localY, worldX, worldY;
+    vector<unsigned char> moved;
+};
 
+const int BODY_SUN = 0;
+const int BODY_PLANET = 1;
+const int BODY_MOON = 2;
+const int BODY_DWARF = 3;
+const int BODY_COMET = 4;
+const int BODY_ASTEROID = 5;
+
+struct ControlState {
+    int currentFrame, zoomPlanetIndex, selectedBody;
+    bool isPaused, showHelp, eclipseMode, nbodyMode, nbodyLeapfrog, multiView, showTrails;
+    float speedMultiplier, timeWarp;
+    bool planetPaused[8];
+    int paceCycles, qualityCycles;
+};
 
-float ringAngle[8] = {0};
+struct SimSnapshot {
+    SimState state;
+    float speed, warp;
+    bool paused;
+    bool planetPaused[8];
+};
 
+struct ParticleBatch {
+    vector<float> vertices;
+    vector<unsigned char> colors;
+    int count;
+    float pointSize, streakLength;
+    bool additive;
+};
 
-float cloudAngle = 0.0f;
+struct EclipseEvent {
+    int kind, planet, moon, depth;
+    double start, peak, end;
+};
 
+const int EVENT_MOON_ECLIPSE = 0;
+const int EVENT_SHADOW_TRANSIT = 1;
+const int EVENT_SUN_TRANSIT = 2;
+
+const int DEPTH_PENUMBRAL = 0;
+const int DEPTH_PARTIAL = 1;
+const int DEPTH_TOTAL = 2;
+
+struct FrameState {
+    SimState sim;
+    ControlState controls;
+    float cometX, cometY;
+    Body selected;
+    ParticleBatch dust, shootingStars, meteors, cometTail;
+    vector<float> nbodyPoints;
+    vector<float> nbodyAsteroids;
+    vector<EclipseEvent> eclipses;
+    vector<float> trailPoints;
+    vector<long long> trailSerials;
+    vector<unsigned char> trailClasses;
+    int bodyCount;
+    unsigned int inputSequence;
+    double updateStartUs, generateStartUs;
+    float updateMs, generateMs;
+};
 
-bool eclipseMode = false;
+struct InputEvent { int type, key; float x, y; unsigned int sequence; };
 
+const int INPUT_KEY = 0;
+const int INPUT_SPECIAL = 1;
+const int INPUT_MOUSE = 2;
 
-bool planetPaused[8] = {false, false, false, false, false, false, false, false};
+
+SimState liveSim = {0, 0.0, 0.0, {0}, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, {0}, -1.5f, -1.2f, 0.0f};
+ControlState liveControls = {1, -1, -1, false, false, false, false, true, false, true, 1.0f, 1.0f, {false}, 0, 0};
+SimState sim = liveSim;
+
+// Phases are wrapped to a period that every consumer's multiplier divides evenly, so the wrap is
+// invisible: effectTime serves effect rates that are multiples of 0.001 radians per angle unit.
+const double TWO_PI = 6.283185307179586;
+const double EFFECT_PERIOD = 1000.0 * TWO_PI;
+const double ROTATION_PERIOD = 18000.0;
+const double CLOUD_PERIOD = 3600.0;
+const double RING_PERIOD = 1800.0;
+const float MAX_TIME_WARP = 1e6f;
+
+double wrapPeriod(double v, double period) {
+    v = fmod(v, period);
+    return v < 0.0 ? v + period : v;
+}
+
+float wrapDegrees(double degrees) {
+    return wrapPeriod(degrees, 360.0);
+}
+
+float wrapRadians(double radians) {
+    return wrapPeriod(radians, TWO_PI);
+}
+
+vector<EclipseEvent> eclipseEvents;
+double eclipseSearchedFrom = 0.0, eclipseSearchedTo = -1.0;
+double eclipseHorizon = 3000.0;
+const double ECLIPSE_SUN_RADIUS = 0.12;
+
+const int SNAPSHOT_CAPACITY = 16384;
+int snapshotInterval = 60;
+vector<SimSnapshot> snapshotRing;
+int snapshotHead = 0, snapshotCount = 0;
+
+
+FrameState frameStates[3];
+atomic<int> frameExchange(2 | 4);
+int frameWriteIndex = 0, frameReadIndex = 1;
+const FrameState* frameView = &frameStates[1];
+
+const int INPUT_QUEUE_SIZE = 256;
+InputEvent inputQueue[INPUT_QUEUE_SIZE];
+atomic<unsigned int> inputHead(0), inputTail(0);
+
+struct ReplayEvent { long long tick; InputEvent event; };
+
+unsigned int sessionSeed = time(0);
+bool sessionSeedPinned = false;
+unsigned int simRandomState = 1;
+FILE* recordFile = nullptr;
+vector<ReplayEvent> replayEvents;
+size_t replayNext = 0;
+bool replaying = false;
+int replayDust = 0, replayNBodyCount = 0;
+bool replayNBody = false;
+long long replayStartTick = 0, replayEndTick = 0;
+unsigned long long replayExpectedChecksum = 0, replayChecksum = 0;
+atomic<bool> replayFinished(false);
+
+bool simThreaded = true;
+atomic<bool> simRunning(false);
+thread simThread;
+const chrono::nanoseconds SIM_PERIOD(16666667);
+
+const int PACE_VSYNC = 0;
+const int PACE_TARGET = 1;
+const int PACE_UNCAPPED = 2;
+const int PACE_HISTORY = 240;
+
+int paceMode = PACE_TARGET;
+double paceTargetHz = 60.0;
+chrono::steady_clock::time_point paceDeadline, paceLastPresent, paceLastSimStep;
+float paceIntervals[PACE_HISTORY];
+int paceIntervalHead = 0, paceIntervalCount = 0;
+float paceMeanMs = 0.0f, paceJitterMs = 0.0f, paceWorstMs = 0.0f;
+long long pacePresented = 0, paceMissed = 0;
+bool showPacingStats = true;
+
+const int LATENCY_FRAME_SWITCH = 0;
+const int LATENCY_PAUSE = 1;
+const int LATENCY_KEY = 2;
+const int LATENCY_MOUSE = 3;
+const int LATENCY_KINDS = 4;
+const int LATENCY_HISTORY = 256;
+const int LATENCY_PER_FRAME = 4;
+const char* latencyNames[] = {"FRAME", "PAUSE", "KEY", "MOUSE"};
+
+struct PendingInput { unsigned int sequence; int kind; double startUs; };
+struct InputLatency { int kind; double startUs; float ms, p50, p95, p99; };
+struct LatencyStats {
+    float samples[LATENCY_HISTORY];
+    int head, count;
+    long long total;
+    float p50, p95, p99;
+};
+
+unsigned int inputSequence = 0, liveInputSequence = 0;
+PendingInput pendingInputs[INPUT_QUEUE_SIZE];
+unsigned int pendingHead = 0, pendingTail = 0;
+LatencyStats latencyStats[LATENCY_KINDS];
+InputLatency frameInputs[LATENCY_PER_FRAME];
+int frameInputCount = 0;
+
+struct QualityTier {
+    int glowLayers, glowSegments, heatwaveLoops, coronaRings, ringSegments;
+    int auroraStrips, auroraSteps, milkyWayColumns, particleStride;
+    bool smoothing;
+};
+
+const QualityTier qualityTiers[] = {
+    {4, 16, 1, 1, 24, 24, 4, 50, 4, false},
+    {7, 24, 2, 2, 36, 36, 6, 100, 3, false},
+    {11, 32, 3, 2, 48, 48, 8, 150, 2, true},
+    {15, 40, 5, 3, 60, 60, 10, 200, 1, true},
+};
+const int QUALITY_TIER_COUNT = 4;
+
+int qualityTier = QUALITY_TIER_COUNT - 1;
+bool qualityAuto = true;
+float qualityFrameMs = 0.0f;
+int qualityOverBudget = 0, qualityUnderBudget = 0, qualityCooldown = 0;
+int paceCyclesApplied = 0, qualityCyclesApplied = 0;
+float qualityBudgetMs = 0.0f;
+
+bool multiView = false;
+bool drawingTile = false;
+int windowWidth = SCR_WIDTH, windowHeight = SCR_HEIGHT;
+double tileStartUs[4] = {0.0, 0.0, 0.0, 0.0};
+float tileMs[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+float tileAverageMs[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
 
-float coronaAngle = 0.0f;
+int currentFrame = 1;
+int zoomPlanetIndex = -1;
+int selectedBody = -1;
+bool isPaused = false;
+float speedMultiplier = 1.0f;
+float timeWarp = 1.0f;
+bool showHelp = false;
+
+
+float planetRotationSpeeds[] = {0.5f, 0.3f, 1.0f, 0.9f, 2.5f, 2.2f, 1.5f, 1.6f};
 
 
-float heatwavePhase = 0.0f;
+bool eclipseMode = false;
 
 
-float cometX = -1.5f;
-float aircraftX = -1.2f;
+bool planetPaused[8] = {false, false, false, false, false, false, false, false};
 
 
 string planetNames[] = {"MERCURY", "VENUS", "EARTH", "MARS", "JUPITER", "SATURN", "URANUS", "NEPTUNE"};
@@ -80,17 +306,103 @@ int moonCounts[] = {0, 0, 1, 2, 4, 3, 2, 1};
 
 struct Star { float x, y, brightness, twinkleSpeed; };
 struct Asteroid { float angle, distance, size, speed; };
-struct SpaceDust { float x, y, vx, vy, size, alpha; };
-struct ShootingStar { float x, y, vx, vy, life, maxLife; bool active; };
 struct Constellation { float x, y; };
 
 vector<Star> stars;
 vector<Asteroid> asteroids;
-vector<SpaceDust> spaceDust;
-vector<ShootingStar> shootingStars;
 
 
-float shootingStarTimer = 0;
+const int CATALOG_MAG_STEPS = 32;
+const float CATALOG_MAG_STEP = 0.5f;
+
+struct CatalogStar { float x, y, magnitude, twinkleSpeed; };
+struct CatalogHeader { char magic[8]; int tilesPerSide, magSteps; float extent, magStep; long long starCount; };
+struct CatalogTileEntry { long long offset; int count; int cumulative[CATALOG_MAG_STEPS]; };
+
+struct CatalogTile {
+    vector<CatalogStar> stars;
+    int requested;
+    long long lastUsed;
+};
+
+string catalogPath;
+CatalogHeader catalogHeader;
+vector<CatalogTileEntry> catalogIndex;
+vector<CatalogTile> catalogTiles;
+vector<int> catalogRequests;
+long long catalogResident = 0, catalogFrame = 0;
+long long catalogCacheBudget = 4000000;
+int catalogStarBudget = 4000;
+float catalogMagnitudeLimit = 0.0f;
+int catalogDrawn = 0;
+mutex catalogMutex;
+condition_variable catalogCondition;
+bool catalogStopping = false;
+thread catalogLoader;
+ParticleBatch catalogBatches[3];
+
+const int TRAIL_CLASS_COUNT = 12;
+const unsigned char TRAIL_HIDDEN = 255;
+const int TRAIL_SAMPLE_HISTORY = 16;
+
+int trailLength = 128, trailDecimation = 4, trailBodyLimit = 4096;
+bool showTrails = true;
+vector<float> trailPositions;
+vector<unsigned char> trailRamps;
+vector<unsigned char> trailClasses;
+int trailBodies = 0, trailHead = -1, trailFilled = 0;
+long long trailLastSerial = 0;
+vector<float> trailSampleRing;
+int trailSampleBodies = 0;
+long long trailSampleSerial = 0, trailSampleFloor = 0;
+atomic<long long> trailConsumedSerial(0);
+float viewHalfWidth = SCR_WIDTH / (float)SCR_HEIGHT, viewHalfHeight = 1.0f;
+
+struct Camera {
+    float x, y, zoom;
+    float fromX, fromY, fromZoom, transition;
+    int target;
+};
+
+const float CAMERA_TRANSITION_SECONDS = 0.8f;
+Camera cameras[5] = {
+    {0, 0, 1, 0, 0, 1, 1, -1}, {0, 0, 1, 0, 0, 1, 1, -1}, {0, 0, 1, 0, 0, 1, 1, -1},
+    {0, 0, 1, 0, 0, 1, 1, -1}, {0, 0, 1, 0, 0, 1, 1, -1},
+};
+
+void applyCamera(const Camera& cam) {
+    glScalef(cam.zoom, cam.zoom, 1.0f);
+    glTranslatef(-cam.x, -cam.y, 0.0f);
+}
+
+bool cameraVisible(const Camera& cam, float x, float y, float r) {
+    return fabs(x - cam.x) - r < viewHalfWidth / cam.zoom && fabs(y - cam.y) - r < viewHalfHeight / cam.zoom;
+}
+
+
+struct ParticlePool {
+    int capacity, count;
+    vector<float> x, y, vx, vy, age, life, r, g, b, a;
+    float pointSize, streakLength, wrapExtent;
+    bool additive, fadeInOut;
+};
+
+struct ParticleEmitter {
+    float rate, accumulator;
+    float x, y, spreadX, spreadY;
+    float vx, vy, spreadV;
+    float life, lifeJitter;
+    float r, g, b, a;
+};
+
+int dustCount = 100;
+ParticlePool dustPool;
+ParticlePool shootingStarPool;
+ParticlePool meteorPool;
+ParticlePool cometTailPool;
+ParticleEmitter shootingStarEmitter;
+ParticleEmitter meteorEmitter;
+ParticleEmitter cometTailEmitter;
 
 
 float plutoDistance = 1.15f;
@@ -98,257 +410,2236 @@ float plutoSpeed = 0.1f;
 float plutoSize = 0.008f;
 
 
-float ceresAngle = 0.0f;
 float ceresDistance = 0.62f;
 float ceresSize = 0.006f;
 
 
-
-void drawCircle(float x, float y, float r, int seg, bool line = false) {
-    if (line) {
-        glBegin(GL_LINE_LOOP);
-    } else {
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(x, y);
-    }
-    for (int i = 0; i <= seg; i++) {
-        float theta = 2.0f * PI * i / seg;
-        glVertex2f(x + r * cos(theta), y + r * sin(theta));
-    }
-    glEnd();
+TransformGraph liveTransforms;
+TransformGraph frameTransforms;
+int planetNodes[8], moonNodes[8];
+int ceresNode, plutoNode, charonNode;
+int earthViewNode, issNode, satelliteNodes, earthMoonNode;
+
+int addTransformNode(TransformGraph& g, int parent, float orbit, float rate, float phase, float radius) {
+    g.parent.push_back(parent);
+    g.orbit.push_back(orbit);
+    g.rate.push_back(rate);
+    g.phase.push_back(phase);
+    g.radius.push_back(radius);
+    g.angle.push_back(-1.0f);
+    g.localX.push_back(0.0f);
+    g.localY.push_back(0.0f);
+    g.worldX.push_back(0.0f);
+    g.worldY.push_back(0.0f);
+    g.moved.push_back(1);
+    return g.parent.size() - 1;
 }
 
-void drawEllipse(float x, float y, float rx, float ry, int seg, bool line = false) {
-    if (line) {
-        glBegin(GL_LINE_LOOP);
-    } else {
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(x, y);
+void buildTransformGraph(TransformGraph& g) {
+    g = TransformGraph();
+    int sun = addTransformNode(g, -1, 0.0f, 0.0f, 0.0f, 0.12f);
+    for (int i = 0; i < 8; i++) {
+        planetNodes[i] = addTransformNode(g, sun, distances[i], speeds[i], 0.0f, planetSizes[i]);
     }
-    for (int i = 0; i <= seg; i++) {
-        float theta = 2.0f * PI * i / seg;
-        glVertex2f(x + rx * cos(theta), y + ry * sin(theta));
+    for (int i = 0; i < 8; i++) {
+        moonNodes[i] = g.parent.size();
+        for (int m = 0; m < moonCounts[i]; m++) {
+            addTransformNode(g, planetNodes[i], planetSizes[i] * (2.0f + m * 0.8f), 2.0f - m * 0.3f, m * 60.0f,
+                             planetSizes[i] * (0.15f + m * 0.05f));
+        }
     }
-    glEnd();
+    ceresNode = addTransformNode(g, sun, ceresDistance, 0.008f * 180.0f / PI, 0.0f, ceresSize);
+    plutoNode = addTransformNode(g, sun, plutoDistance, plutoSpeed, 0.0f, plutoSize);
+    charonNode = addTransformNode(g, plutoNode, plutoSize * 2.5f, plutoSpeed * 3.0f, 0.0f, plutoSize * 0.5f);
+
+    earthViewNode = addTransformNode(g, -1, 0.0f, 0.0f, 0.0f, 0.28f);
+    float earthRadius = g.radius[earthViewNode];
+    issNode = addTransformNode(g, earthViewNode, earthRadius * 1.15f, 0.05f, 0.0f, 0.025f);
+    satelliteNodes = g.parent.size();
+    for (int s = 0; s < 3; s++) {
+        addTransformNode(g, earthViewNode, earthRadius * (1.25f + s * 0.08f), (0.03f + s * 0.01f) * 180.0f / PI,
+                         s * 120.0f, 0.0f);
+    }
+    earthMoonNode = addTransformNode(g, earthViewNode, 0.5f, 4.0f, 0.0f, 0.08f);
 }
 
-void drawGlow(float x, float y, float r, float red, float green, float blue, float intensity = 0.3f) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    int layers = 15;
-    for (int i = 0; i < layers; i++) {
-        float ratio = (float)i / layers;
-        float currentR = r * (1.0f + ratio * 1.5f);
-        float alpha = (1.0f - ratio) * intensity;
-        glColor4f(red, green, blue, alpha);
-        drawCircle(x, y, currentR, 40);
+void updateTransforms(TransformGraph& g, double angle) {
+    int count = g.parent.size();
+    for (int i = 0; i < count; i++) {
+        int p = g.parent[i];
+        float a = wrapDegrees(angle * g.rate[i] + g.phase[i]);
+        bool moved = a != g.angle[i];
+        if (moved) {
+            float rad = a * PI / 180.0f;
+            g.angle[i] = a;
+            g.localX[i] = g.orbit[i] * cos(rad);
+            g.localY[i] = g.orbit[i] * sin(rad);
+        }
+        if (p >= 0 && g.moved[p]) moved = true;
+        g.moved[i] = moved;
+        if (!moved) continue;
+        g.worldX[i] = g.localX[i] + (p >= 0 ? g.worldX[p] : 0.0f);
+        g.worldY[i] = g.localY[i] + (p >= 0 ? g.worldY[p] : 0.0f);
     }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
 
-void drawSunRays(float x, float y, float r, float rotationOffset) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    int numRays = 16;
-    for (int i = 0; i < numRays; i++) {
-        float angle = (2.0f * PI * i / numRays) + rotationOffset;
-        glBegin(GL_TRIANGLES);
-        glColor4f(1.0f, 0.9f, 0.5f, 0.6f);
-        glVertex2f(x + r * cos(angle - 0.05f), y + r * sin(angle - 0.05f));
-        glVertex2f(x + r * cos(angle + 0.05f), y + r * sin(angle + 0.05f));
-        glColor4f(1.0f, 0.7f, 0.0f, 0.0f);
-        glVertex2f(x + r * 2.5f * cos(angle), y + r * 2.5f * sin(angle));
-        glEnd();
-    }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-}
+struct NBodyParticle { float x, y, vx, vy, ax, ay, mass; int id; };
+struct QuadNode { float cx, cy, half, mass, comX, comY; int child[4]; int first, count; bool leaf; };
 
+bool nbodyMode = false;
+int nbodyParticleCount = 100000;
+int nbodyStepCount = 0;
+int nbodyCometSlot = 0;
+float nbodyTheta = 0.7f;
+float nbodySoftening = 0.003f;
+float nbodyBeltMass = 1e-4f;
+float nbodyPlanetMassScale = 1.0f;
+const float NBODY_GM_SUN = 6e-6f;
+float planetMasses[] = {1.7e-7f, 2.4e-6f, 3.0e-6f, 3.2e-7f, 9.5e-4f, 2.9e-4f, 4.4e-5f, 5.1e-5f};
+vector<NBodyParticle> nbodyParticles;
+vector<QuadNode> quadNodes;
 
-void drawCorona(float x, float y, float r, float angle) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 
-    for (int ring = 0; ring < 3; ring++) {
-        float ringR = r * (1.2f + ring * 0.15f);
-        glBegin(GL_TRIANGLE_STRIP);
-        for (int i = 0; i <= 60; i++) {
-            float theta = 2.0f * PI * i / 60 + angle + ring * 0.5f;
-            float wave = sin(theta * 5 + ring) * 0.02f;
-            float alpha = 0.15f - ring * 0.04f;
-            glColor4f(1.0f, 0.9f, 0.7f, alpha);
-            glVertex2f(x + (ringR + wave) * cos(theta), y + (ringR + wave) * sin(theta));
-            glVertex2f(x + (ringR + wave + 0.03f) * cos(theta), y + (ringR + wave + 0.03f) * sin(theta));
-        }
-        glEnd();
-    }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-}
+const size_t FRAME_ARENA_BLOCK = 1 << 20;
+const int ALLOC_AUDIT_WARMUP = 120;
 
-void drawHeatwave(float x, float y, float baseR, float phase) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+struct ArenaBlock { unsigned char* data; size_t size; };
+struct FrameArena {
+    vector<ArenaBlock> blocks;
+    int block;
+    size_t used, frameBytes, peakBytes, reservedBytes;
+};
 
-    for (int i = 0; i < 5; i++) {
-        float offset = i * 0.8f;
-        glBegin(GL_LINE_LOOP);
-        for (int j = 0; j <= 60; j++) {
-            float theta = 2.0f * PI * j / 60;
-            float wave = sin(theta * 3 + phase + offset) * 0.015f;
-            float r = baseR * (1.05f + i * 0.05f) + wave;
-            float alpha = (0.15f - i * 0.02f) * (1.0f + 0.3f * sin(phase * 2 + i));
-            glColor4f(1.0f, 0.8f, 0.4f, alpha);
-            glVertex2f(x + r * cos(theta), y + r * sin(theta));
-        }
-        glEnd();
-    }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+FrameArena frameArena = {{}, 0, 0, 0, 0, 0};
+atomic<long long> heapAllocations(0);
+bool allocAudit = false;
+long long allocAuditFrames = 0;
+long long allocAuditDirtyFrames = 0;
+long long allocAuditStart = 0;
+// Set on the render thread for the span of an audited frame, and on pool workers while they run a job
+// that thread submitted, so allocations by the simulation, loader and writer threads are not counted.
+thread_local bool allocCounting = false;
+
+void* operator new(size_t size) {
+    if (allocCounting) heapAllocations.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
 }
 
+// Without noinline, GCC inlines the free() into callers of delete and then warns that memory from
+// operator new is released with free (-Wmismatched-new-delete), the very pairing these replacements use.
+#if defined(__GNUC__)
+#define HEAP_HOOK __attribute__((noinline))
+#else
+#define HEAP_HOOK
+#endif
 
-void drawSunspots(float x, float y, float r, float rotation) {
-    glEnable(GL_BLEND);
-
-    float spotData[][3] = {
-        {0.3f, 0.4f, 0.12f},
-        {-0.5f, -0.2f, 0.08f},
-        {0.1f, -0.6f, 0.1f},
-        {-0.3f, 0.5f, 0.06f}
-    };
+HEAP_HOOK void operator delete(void* p) noexcept {
+    free(p);
+}
 
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-    glRotatef(rotation, 0, 0, 1);
+HEAP_HOOK void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
 
-    for (int i = 0; i < 4; i++) {
-        float sx = r * spotData[i][0];
-        float sy = r * spotData[i][1];
-        float sr = r * spotData[i][2];
-        
-        glColor4f(0.3f, 0.2f, 0.0f, 0.7f);
-        drawCircle(sx, sy, sr, 20);
-        glColor4f(0.2f, 0.1f, 0.0f, 0.5f);
-        drawCircle(sx, sy, sr * 0.6f, 15);
+void* arenaAllocate(size_t bytes) {
+    bytes = (bytes + 15) & ~(size_t)15;
+    while (frameArena.block < (int)frameArena.blocks.size()
+           && frameArena.used + bytes > frameArena.blocks[frameArena.block].size) {
+        frameArena.block++;
+        frameArena.used = 0;
     }
-
-    glPopMatrix();
+    if (frameArena.block == (int)frameArena.blocks.size()) {
+        size_t size = max(bytes, FRAME_ARENA_BLOCK);
+        frameArena.blocks.push_back({new unsigned char[size], size});
+        frameArena.used = 0;
+    }
+    void* p = frameArena.blocks[frameArena.block].data + frameArena.used;
+    frameArena.used += bytes;
+    frameArena.frameBytes += bytes;
+    return p;
 }
 
-void drawSolarFlares(float x, float y, float r, float time) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-    int numFlares = 3;
-    for (int i = 0; i < numFlares; i++) {
-        float angle = (2.0f * PI * i / numFlares) + time * 0.05f;
-        float flareIntensity = 0.5f + 0.5f * sin(time * 0.3f + i * 2);
-        float flareLength = r * (0.3f + 0.2f * flareIntensity);
-        
-        glBegin(GL_TRIANGLES);
-        glColor4f(1.0f, 0.9f, 0.7f, 0.4f * flareIntensity);
-        glVertex2f(x + r * cos(angle - 0.1f), y + r * sin(angle - 0.1f));
-        glVertex2f(x + r * cos(angle + 0.1f), y + r * sin(angle + 0.1f));
-        glColor4f(1.0f, 0.5f, 0.0f, 0.0f);
-        glVertex2f(x + (r + flareLength) * cos(angle), y + (r + flareLength) * sin(angle));
-        glEnd();
-    }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+// Announces a per-frame workload that is still ramping up (trails filling in), so the arena is sized
+// for it once rather than regrown each time the ramp crosses a block boundary.
+void arenaReserve(size_t bytes) {
+    frameArena.reservedBytes = bytes;
 }
 
-void drawRing(float x, float y, float innerR, float outerR, int seg, float r, float g, float b, float a) {
-    glEnable(GL_BLEND);
-    glBegin(GL_QUAD_STRIP);
-    for (int i = 0; i <= seg; i++) {
-        float theta = 2.0f * PI * i / seg;
-        glColor4f(r, g, b, a);
-        glVertex2f(x + innerR * cos(theta), y + innerR * sin(theta));
-        glVertex2f(x + outerR * cos(theta), y + outerR * sin(theta));
-    }
-    glEnd();
+template <class T>
+T* arenaArray(size_t count) {
+    return (T*)arenaAllocate(count * sizeof(T));
 }
 
-void drawAnimatedRing(float x, float y, float innerR, float outerR, int seg,
-                      float r, float g, float b, float a, float rotation) {
-    glEnable(GL_BLEND);
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-    glRotatef(rotation, 0, 0, 1);
+const char* arenaPrintf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(nullptr, 0, format, args);
+    va_end(args);
+    char* text = arenaArray<char>(length + 1);
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    return text;
+}
 
-    glBegin(GL_QUAD_STRIP);
-    for (int i = 0; i <= seg; i++) {
-        float theta = 2.0f * PI * i / seg;
-        glColor4f(r, g, b, a * (0.8f + 0.2f * sin(theta * 5)));
-        glVertex2f(innerR * cos(theta), innerR * sin(theta));
-        glVertex2f(outerR * cos(theta), outerR * sin(theta));
+void beginFrameAllocations() {
+    allocCounting = allocAudit;
+    allocAuditStart = heapAllocations.load();
+    frameArena.peakBytes = max(frameArena.peakBytes, frameArena.frameBytes);
+    size_t wanted = max(frameArena.peakBytes, frameArena.reservedBytes) * 2;
+    if (frameArena.blocks.size() > 1 || (frameArena.blocks.size() == 1 && frameArena.blocks[0].size < wanted)) {
+        size_t size = FRAME_ARENA_BLOCK;
+        while (size < wanted) size *= 2;
+        for (auto& b : frameArena.blocks) delete[] b.data;
+        frameArena.blocks.assign(1, {new unsigned char[size], size});
     }
-    glEnd();
-
-    glPopMatrix();
+    frameArena.block = 0;
+    frameArena.used = 0;
+    frameArena.frameBytes = 0;
 }
 
-void drawStars() {
-    glEnable(GL_BLEND);
-    for (auto& s : stars) {
-        float twinkle = 0.5f + 0.5f * sin(angleAll * s.twinkleSpeed + s.x * 10);
-        float brightness = s.brightness * twinkle;
-        glColor4f(brightness, brightness, brightness * 1.1f, 1.0f);
-        glPointSize(1.0f + brightness * 2.0f);
-        glBegin(GL_POINTS);
-        glVertex2f(s.x, s.y);
-        glEnd();
+void endFrameAllocations() {
+    allocCounting = false;
+    if (!allocAudit) return;
+    long long count = heapAllocations.load() - allocAuditStart;
+    allocAuditFrames++;
+    if (allocAuditFrames <= ALLOC_AUDIT_WARMUP || count == 0) return;
+    allocAuditDirtyFrames++;
+    if (allocAuditDirtyFrames <= 10) {
+        cerr << "Allocation audit: frame " << allocAuditFrames << " made " << count << " heap allocations" << endl;
     }
 }
 
+bool reportAllocAudit() {
+    if (!allocAudit) return true;
+    long long steady = max(0LL, allocAuditFrames - ALLOC_AUDIT_WARMUP);
+    cout << "Allocation audit: " << allocAuditDirtyFrames << " of " << steady
+         << " steady-state frames allocated, frame arena peak " << frameArena.peakBytes << " bytes in "
+         << frameArena.blocks.size() << " blocks" << endl;
+    return allocAuditDirtyFrames == 0;
+}
 
-void drawSpaceDust() {
-    glEnable(GL_BLEND);
-    glPointSize(1.0f);
+struct WorkerPool {
+    mutex submit, lock;
+    condition_variable wake, finished;
+    void (*call)(void*, int);
+    void* context;
+    int threads, workers, running;
+    long long generation;
+    bool counting;
+};
 
-    for (auto& d : spaceDust) {
-        glColor4f(0.7f, 0.7f, 0.8f, d.alpha);
-        glBegin(GL_POINTS);
-        glVertex2f(d.x, d.y);
-        glEnd();
+WorkerPool* workerPool = nullptr;
+
+void workerLoop(int index) {
+    WorkerPool& pool = *workerPool;
+    long long seen = 0;
+    for (;;) {
+        unique_lock<mutex> lock(pool.lock);
+        pool.wake.wait(lock, [&] { return pool.generation != seen; });
+        seen = pool.generation;
+        if (index >= pool.workers) continue;
+        allocCounting = pool.counting;
+        lock.unlock();
+        pool.call(pool.context, index);
+        allocCounting = false;
+        lock.lock();
+        if (--pool.running == 0) pool.finished.notify_one();
     }
 }
 
-void drawOrbit(float radius, int segments) {
-    glEnable(GL_BLEND);
-    glBegin(GL_LINE_LOOP);
-    for (int i = 0; i < segments; i++) {
-        float theta = 2.0f * PI * i / segments;
-        glColor4f(0.3f, 0.3f, 0.4f, 0.3f);
-        glVertex2f(radius * cos(theta), radius * sin(theta));
+void runOnWorkers(int workers, void (*call)(void*, int), void* context) {
+    if (workers <= 1) {
+        call(context, 0);
+        return;
     }
-    glEnd();
-}
-
-void drawAsteroidBelt() {
-    glColor4f(0.5f, 0.5f, 0.5f, 0.7f);
-    for (auto& a : asteroids) {
-        float x = a.distance * cos(a.angle + angleAll * a.speed);
-        float y = a.distance * sin(a.angle + angleAll * a.speed);
-        drawCircle(x, y, a.size, 8);
+    if (!workerPool) workerPool = new WorkerPool{{}, {}, {}, {}, nullptr, nullptr, 0, 0, 0, 0, false};
+    WorkerPool& pool = *workerPool;
+    lock_guard<mutex> submit(pool.submit);
+    for (; pool.threads < workers - 1; pool.threads++) thread(workerLoop, pool.threads + 1).detach();
+    {
+        lock_guard<mutex> lock(pool.lock);
+        pool.call = call;
+        pool.context = context;
+        pool.workers = workers;
+        pool.running = workers - 1;
+        pool.counting = allocCounting;
+        pool.generation++;
     }
+    pool.wake.notify_all();
+    call(context, 0);
+    unique_lock<mutex> lock(pool.lock);
+    pool.finished.wait(lock, [&] { return pool.running == 0; });
+}
 
-  
-    float cx = ceresDistance * cos(ceresAngle);
-    float cy = ceresDistance * sin(ceresAngle);
-    glColor4f(0.7f, 0.7f, 0.6f, 1.0f);
-    drawCircle(cx, cy, ceresSize, 12);
-    drawGlow(cx, cy, ceresSize, 0.6f, 0.6f, 0.5f, 0.15f);
+template <class F>
+void runParallel(int workers, const F& job) {
+    runOnWorkers(workers, [](void* context, int index) { (*(const F*)context)(index); }, (void*)&job);
 }
 
+const int SW_TILE_SIZE = 64;
+const int SW_TRIANGLE = 0;
+const int SW_LINE = 1;
+const int SW_POINT = 2;
+const int SW_CLEAR = 3;
+const int SW_BITMAP = 4;
+
+struct SwVertex { float x, y, s, t; float color[4]; };
+
+struct SwTriangle {
+    long long a[3], b[3], c[3];
+    float x0, y0;
+    float color[4], colorDx[4], colorDy[4];
+    float s, sDx, sDy, t, tDx, tDy;
+    int level;
+};
 
-void drawDayNightMask(float cx, float cy, float r, float angleDeg) {
-    glPushMatrix();
-    glTranslatef(cx, cy, 0);
-    glRotatef(angleDeg, 0, 0, 1);
-    glEnable(GL_BLEND);
-    glColor4f(0, 0, 0, 0.5f);
+struct SwPrimitive {
+    int kind, index, texture;
+    int x0, y0, x1, y1;
+    GLenum src, dst;
+    bool smooth;
+    float size;
+    const unsigned char* bitmap;
+};
 
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(0, 0);
+struct SwTexture {
+    vector<vector<unsigned char>> levels;
+    vector<int> widths, heights;
+    GLint wrapS, wrapT;
+};
+
+struct SwMatrix { float m[16]; };
+
+const SwMatrix SW_IDENTITY = {{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+
+struct SwArray {
+    bool enabled;
+    int size, stride;
+    GLenum type;
+    const unsigned char* pointer;
+};
+
+// 5x7 glyphs for ASCII 32-126, one byte per column with the top row in bit 0.
+const unsigned char swFont[95 * 5] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5F, 0x00, 0x00, 0x00, 0x07, 0x00, 0x07, 0x00, 0x14, 0x7F, 0x14, 0x7F, 0x14,
+    0x24, 0x2A, 0x7F, 0x2A, 0x12, 0x23, 0x13, 0x08, 0x64, 0x62, 0x36, 0x49, 0x56, 0x20, 0x50, 0x00, 0x08, 0x07, 0x03, 0x00,
+    0x00, 0x1C, 0x22, 0x41, 0x00, 0x00, 0x41, 0x22, 0x1C, 0x00, 0x2A, 0x1C, 0x7F, 0x1C, 0x2A, 0x08, 0x08, 0x3E, 0x08, 0x08,
+    0x00, 0x50, 0x30, 0x00, 0x00, 0x08, 0x08, 0x08, 0x08, 0x08, 0x00, 0x60, 0x60, 0x00, 0x00, 0x20, 0x10, 0x08, 0x04, 0x02,
+    0x3E, 0x51, 0x49, 0x45, 0x3E, 0x00, 0x42, 0x7F, 0x40, 0x00, 0x42, 0x61, 0x51, 0x49, 0x46, 0x21, 0x41, 0x45, 0x4B, 0x31,
+    0x18, 0x14, 0x12, 0x7F, 0x10, 0x27, 0x45, 0x45, 0x45, 0x39, 0x3C, 0x4A, 0x49, 0x49, 0x30, 0x01, 0x71, 0x09, 0x05, 0x03,
+    0x36, 0x49, 0x49, 0x49, 0x36, 0x06, 0x49, 0x49, 0x29, 0x1E, 0x00, 0x36, 0x36, 0x00, 0x00, 0x00, 0x56, 0x36, 0x00, 0x00,
+    0x08, 0x14, 0x22, 0x41, 0x00, 0x14, 0x14, 0x14, 0x14, 0x14, 0x00, 0x41, 0x22, 0x14, 0x08, 0x02, 0x01, 0x51, 0x09, 0x06,
+    0x32, 0x49, 0x79, 0x41, 0x3E, 0x7E, 0x11, 0x11, 0x11, 0x7E, 0x7F, 0x49, 0x49, 0x49, 0x36, 0x3E, 0x41, 0x41, 0x41, 0x22,
+    0x7F, 0x41, 0x41, 0x22, 0x1C, 0x7F, 0x49, 0x49, 0x49, 0x41, 0x7F, 0x09, 0x09, 0x09, 0x01, 0x3E, 0x41, 0x49, 0x49, 0x7A,
+    0x7F, 0x08, 0x08, 0x08, 0x7F, 0x00, 0x41, 0x7F, 0x41, 0x00, 0x20, 0x40, 0x41, 0x3F, 0x01, 0x7F, 0x08, 0x14, 0x22, 0x41,
+    0x7F, 0x40, 0x40, 0x40, 0x40, 0x7F, 0x02, 0x0C, 0x02, 0x7F, 0x7F, 0x04, 0x08, 0x10, 0x7F, 0x3E, 0x41, 0x41, 0x41, 0x3E,
+    0x7F, 0x09, 0x09, 0x09, 0x06, 0x3E, 0x41, 0x51, 0x21, 0x5E, 0x7F, 0x09, 0x19, 0x29, 0x46, 0x46, 0x49, 0x49, 0x49, 0x31,
+    0x01, 0x01, 0x7F, 0x01, 0x01, 0x3F, 0x40, 0x40, 0x40, 0x3F, 0x1F, 0x20, 0x40, 0x20, 0x1F, 0x3F, 0x40, 0x38, 0x40, 0x3F,
+    0x63, 0x14, 0x08, 0x14, 0x63, 0x07, 0x08, 0x70, 0x08, 0x07, 0x61, 0x51, 0x49, 0x45, 0x43, 0x00, 0x7F, 0x41, 0x41, 0x00,
+    0x02, 0x04, 0x08, 0x10, 0x20, 0x00, 0x41, 0x41, 0x7F, 0x00, 0x04, 0x02, 0x01, 0x02, 0x04, 0x40, 0x40, 0x40, 0x40, 0x40,
+    0x00, 0x01, 0x02, 0x04, 0x00, 0x20, 0x54, 0x54, 0x54, 0x78, 0x7F, 0x48, 0x44, 0x44, 0x38, 0x38, 0x44, 0x44, 0x44, 0x20,
+    0x38, 0x44, 0x44, 0x48, 0x7F, 0x38, 0x54, 0x54, 0x54, 0x18, 0x08, 0x7E, 0x09, 0x01, 0x02, 0x0C, 0x52, 0x52, 0x52, 0x3E,
+    0x7F, 0x08, 0x04, 0x04, 0x78, 0x00, 0x44, 0x7D, 0x40, 0x00, 0x20, 0x40, 0x44, 0x3D, 0x00, 0x7F, 0x10, 0x28, 0x44, 0x00,
+    0x00, 0x41, 0x7F, 0x40, 0x00, 0x7C, 0x04, 0x18, 0x04, 0x78, 0x7C, 0x08, 0x04, 0x04, 0x78, 0x38, 0x44, 0x44, 0x44, 0x38,
+    0x7C, 0x14, 0x14, 0x14, 0x08, 0x08, 0x14, 0x14, 0x18, 0x7C, 0x7C, 0x08, 0x04, 0x04, 0x08, 0x48, 0x54, 0x54, 0x54, 0x20,
+    0x04, 0x3F, 0x44, 0x40, 0x20, 0x3C, 0x40, 0x40, 0x20, 0x7C, 0x1C, 0x20, 0x40, 0x20, 0x1C, 0x3C, 0x40, 0x30, 0x40, 0x3C,
+    0x44, 0x28, 0x10, 0x28, 0x44, 0x0C, 0x50, 0x50, 0x50, 0x3C, 0x44, 0x64, 0x54, 0x4C, 0x44, 0x00, 0x08, 0x36, 0x41, 0x00,
+    0x00, 0x00, 0x7F, 0x00, 0x00, 0x00, 0x41, 0x36, 0x08, 0x00, 0x10, 0x08, 0x08, 0x10, 0x08
+};
+
+bool softwareRender = false;
+int swThreads = max(1, (int)thread::hardware_concurrency());
+bool swThreadsPinned = false;
+int swWidth = SCR_WIDTH, swHeight = SCR_HEIGHT;
+vector<float> swColor;
+vector<unsigned char> swPixels;
+vector<SwVertex> swVertices, swBatch;
+vector<SwTriangle> swTriangles;
+vector<SwPrimitive> swPrimitives;
+vector<int> swBinStart;
+int* swBinItems = nullptr;
+vector<SwTexture> swTextures;
+vector<SwMatrix> swStacks[3];
+int swMatrixMode = 0;
+GLenum swBeginMode = GL_POINTS;
+int swViewport[4] = {0, 0, (int)SCR_WIDTH, (int)SCR_HEIGHT};
+int swScissor[4] = {0, 0, (int)SCR_WIDTH, (int)SCR_HEIGHT};
+bool swScissorTest = false, swBlend = false, swPointSmooth = false, swLineSmooth = false, swTexture2D = false;
+GLenum swBlendSrc = GL_ONE, swBlendDst = GL_ZERO;
+float swClearColor[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+float swCurrentColor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+float swPointSize = 1.0f, swLineWidth = 1.0f;
+int swBoundTexture = 0;
+SwArray swVertexArray = {}, swColorArray = {}, swTexCoordArray = {};
+float swRasterX = 0.0f, swRasterY = 0.0f;
+float swRasterColor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+bool swRasterValid = false;
+long long swFlushCount = 0;
+double swFlushMs = 0.0;
+
+void swInitialize(int width, int height) {
+    swWidth = width;
+    swHeight = height;
+    swColor.assign((size_t)width * height * 4, 0.0f);
+    swPixels.assign((size_t)width * height * 4, 0);
+    int tilesX = (width + SW_TILE_SIZE - 1) / SW_TILE_SIZE, tilesY = (height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    swBinStart.assign(tilesX * tilesY + 1, 0);
+    swVertices.reserve(1 << 16);
+    swTriangles.reserve(1 << 16);
+    swPrimitives.reserve(1 << 16);
+    for (auto& stack : swStacks) stack.assign(1, SW_IDENTITY);
+    int full[4] = {0, 0, width, height};
+    memcpy(swViewport, full, sizeof(full));
+    memcpy(swScissor, full, sizeof(full));
+}
+
+// Full trails add one line per segment on top of the base scene, so callers that know the trail
+// size reserve for it up front instead of letting steady-state frames regrow the buffers.
+void swReserveLines(size_t lines) {
+    swVertices.reserve((1 << 16) + 2 * lines);
+    swPrimitives.reserve((1 << 16) + lines);
+}
+
+void swMultiply(const float* m) {
+    float* c = swStacks[swMatrixMode].back().m;
+    float r[16];
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            r[col * 4 + row] = c[row] * m[col * 4] + c[4 + row] * m[col * 4 + 1] + c[8 + row] * m[col * 4 + 2] +
+                               c[12 + row] * m[col * 4 + 3];
+        }
+    }
+    memcpy(c, r, sizeof(r));
+}
+
+void swTransform(const float* m, float x, float y, float* out) {
+    for (int row = 0; row < 4; row++) out[row] = m[row] * x + m[4 + row] * y + m[12 + row];
+}
+
+void swMatrixModeSet(GLenum mode) {
+    swMatrixMode = mode == GL_PROJECTION ? 1 : mode == GL_TEXTURE ? 2 : 0;
+}
+
+void swLoadIdentity() {
+    swStacks[swMatrixMode].back() = SW_IDENTITY;
+}
+
+void swPushMatrix() {
+    swStacks[swMatrixMode].push_back(swStacks[swMatrixMode].back());
+}
+
+void swPopMatrix() {
+    if (swStacks[swMatrixMode].size() > 1) swStacks[swMatrixMode].pop_back();
+}
+
+void swTranslatef(float x, float y, float z) {
+    float m[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, y, z, 1};
+    swMultiply(m);
+}
+
+void swScalef(float x, float y, float z) {
+    float m[16] = {x, 0, 0, 0, 0, y, 0, 0, 0, 0, z, 0, 0, 0, 0, 1};
+    swMultiply(m);
+}
+
+void swRotatef(float angle, float x, float y, float z) {
+    float len = sqrt(x * x + y * y + z * z);
+    if (len == 0.0f) return;
+    x /= len;
+    y /= len;
+    z /= len;
+    float c = cos(angle * PI / 180.0f), s = sin(angle * PI / 180.0f), t = 1.0f - c;
+    float m[16] = {x * x * t + c,     y * x * t + z * s, x * z * t - y * s, 0,
+                   x * y * t - z * s, y * y * t + c,     y * z * t + x * s, 0,
+                   x * z * t + y * s, y * z * t - x * s, z * z * t + c,     0,
+                   0,                 0,                 0,                 1};
+    swMultiply(m);
+}
+
+void swOrtho(double l, double r, double b, double t, double n, double f) {
+    float m[16] = {(float)(2 / (r - l)), 0, 0, 0, 0, (float)(2 / (t - b)), 0, 0, 0, 0, (float)(-2 / (f - n)), 0,
+                   (float)(-(r + l) / (r - l)), (float)(-(t + b) / (t - b)), (float)(-(f + n) / (f - n)), 1};
+    swMultiply(m);
+}
+
+void swViewportSet(int x, int y, int w, int h) {
+    swViewport[0] = x;
+    swViewport[1] = y;
+    swViewport[2] = w;
+    swViewport[3] = h;
+}
+
+void swScissorSet(int x, int y, int w, int h) {
+    swScissor[0] = x;
+    swScissor[1] = y;
+    swScissor[2] = w;
+    swScissor[3] = h;
+}
+
+void swSetCapability(GLenum cap, bool on) {
+    if (cap == GL_BLEND) swBlend = on;
+    else if (cap == GL_SCISSOR_TEST) swScissorTest = on;
+    else if (cap == GL_POINT_SMOOTH) swPointSmooth = on;
+    else if (cap == GL_LINE_SMOOTH) swLineSmooth = on;
+    else if (cap == GL_TEXTURE_2D) swTexture2D = on;
+}
+
+void swEnable(GLenum cap) {
+    swSetCapability(cap, true);
+}
+
+void swDisable(GLenum cap) {
+    swSetCapability(cap, false);
+}
+
+void swBlendFunc(GLenum src, GLenum dst) {
+    swBlendSrc = src;
+    swBlendDst = dst;
+}
+
+void swColor4f(float r, float g, float b, float a) {
+    swCurrentColor[0] = r;
+    swCurrentColor[1] = g;
+    swCurrentColor[2] = b;
+    swCurrentColor[3] = a;
+}
+
+void swColor3f(float r, float g, float b) {
+    swColor4f(r, g, b, 1.0f);
+}
+
+void swPointSizeSet(float size) {
+    swPointSize = size;
+}
+
+void swLineWidthSet(float width) {
+    swLineWidth = width;
+}
+
+void swClearColorSet(float r, float g, float b, float a) {
+    swClearColor[0] = r;
+    swClearColor[1] = g;
+    swClearColor[2] = b;
+    swClearColor[3] = a;
+}
+
+void swIgnore() {}
+
+void swClip(int* rect) {
+    rect[0] = max(0, swViewport[0]);
+    rect[1] = max(0, swViewport[1]);
+    rect[2] = min(swWidth, swViewport[0] + swViewport[2]);
+    rect[3] = min(swHeight, swViewport[1] + swViewport[3]);
+    if (swScissorTest) {
+        rect[0] = max(rect[0], swScissor[0]);
+        rect[1] = max(rect[1], swScissor[1]);
+        rect[2] = min(rect[2], swScissor[0] + swScissor[2]);
+        rect[3] = min(rect[3], swScissor[1] + swScissor[3]);
+    }
+}
+
+SwVertex swWindowVertex(float x, float y, float s, float t, const float* color) {
+    float eye[4], clip[4];
+    swTransform(swStacks[0].back().m, x, y, eye);
+    const float* p = swStacks[1].back().m;
+    for (int row = 0; row < 4; row++) {
+        clip[row] = p[row] * eye[0] + p[4 + row] * eye[1] + p[8 + row] * eye[2] + p[12 + row] * eye[3];
+    }
+    SwVertex v;
+    v.x = swViewport[0] + (clip[0] / clip[3] + 1.0f) * 0.5f * swViewport[2];
+    v.y = swViewport[1] + (clip[1] / clip[3] + 1.0f) * 0.5f * swViewport[3];
+    v.x = min(max(v.x, -65536.0f), 65536.0f);
+    v.y = min(max(v.y, -65536.0f), 65536.0f);
+    float tex[4];
+    swTransform(swStacks[2].back().m, s, t, tex);
+    v.s = tex[0];
+    v.t = tex[1];
+    memcpy(v.color, color, sizeof(v.color));
+    return v;
+}
+
+bool swPrimitiveBase(SwPrimitive& p, int kind, float minX, float minY, float maxX, float maxY) {
+    int clip[4];
+    swClip(clip);
+    p.kind = kind;
+    p.texture = -1;
+    p.x0 = max(clip[0], (int)floor(minX));
+    p.y0 = max(clip[1], (int)floor(minY));
+    p.x1 = min(clip[2], (int)ceil(maxX) + 1);
+    p.y1 = min(clip[3], (int)ceil(maxY) + 1);
+    p.src = swBlend ? swBlendSrc : GL_ONE;
+    p.dst = swBlend ? swBlendDst : GL_ZERO;
+    p.smooth = false;
+    p.size = 1.0f;
+    p.bitmap = nullptr;
+    return p.x0 < p.x1 && p.y0 < p.y1;
+}
+
+void swEmitTriangle(const SwVertex& v0, const SwVertex& v1, const SwVertex& v2) {
+    SwPrimitive p;
+    if (!swPrimitiveBase(p, SW_TRIANGLE, min({v0.x, v1.x, v2.x}) - 1.0f, min({v0.y, v1.y, v2.y}) - 1.0f,
+                         max({v0.x, v1.x, v2.x}), max({v0.y, v1.y, v2.y}))) return;
+
+    long long fx[3] = {llround(v0.x * 256.0f), llround(v1.x * 256.0f), llround(v2.x * 256.0f)};
+    long long fy[3] = {llround(v0.y * 256.0f), llround(v1.y * 256.0f), llround(v2.y * 256.0f)};
+    long long area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fx[2] - fx[0]) * (fy[1] - fy[0]);
+    if (area == 0) return;
+    if (area < 0) {
+        swap(fx[1], fx[2]);
+        swap(fy[1], fy[2]);
+    }
+
+    SwTriangle tri;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        tri.a[i] = fy[i] - fy[j];
+        tri.b[i] = fx[j] - fx[i];
+        tri.c[i] = -(tri.a[i] * fx[i] + tri.b[i] * fy[i]);
+        bool topLeft = tri.a[i] > 0 || (tri.a[i] == 0 && tri.b[i] < 0);
+        if (!topLeft) tri.c[i] -= 1;
+    }
+
+    double dx1 = v1.x - v0.x, dy1 = v1.y - v0.y, dx2 = v2.x - v0.x, dy2 = v2.y - v0.y;
+    double det = dx1 * dy2 - dx2 * dy1;
+    if (fabs(det) < 1e-12) det = det < 0 ? -1e-12 : 1e-12;
+    auto plane = [&](float f0, float f1, float f2, float& dx, float& dy) {
+        dx = (float)(((f1 - f0) * dy2 - (f2 - f0) * dy1) / det);
+        dy = (float)(((f2 - f0) * dx1 - (f1 - f0) * dx2) / det);
+    };
+    tri.x0 = v0.x;
+    tri.y0 = v0.y;
+    for (int k = 0; k < 4; k++) {
+        tri.color[k] = v0.color[k];
+        plane(v0.color[k], v1.color[k], v2.color[k], tri.colorDx[k], tri.colorDy[k]);
+    }
+    tri.s = v0.s;
+    tri.t = v0.t;
+    plane(v0.s, v1.s, v2.s, tri.sDx, tri.sDy);
+    plane(v0.t, v1.t, v2.t, tri.tDx, tri.tDy);
+    tri.level = 0;
+
+    if (swTexture2D && swBoundTexture > 0 && swBoundTexture <= (int)swTextures.size()) {
+        const SwTexture& tex = swTextures[swBoundTexture - 1];
+        if (!tex.levels.empty()) {
+            p.texture = swBoundTexture - 1;
+            float w = tex.widths[0], h = tex.heights[0];
+            float rho = max(hypot(tri.sDx * w, tri.tDx * h), hypot(tri.sDy * w, tri.tDy * h));
+            float lod = rho > 0.0f ? log2(rho) : 0.0f;
+            tri.level = min(max((int)(lod + 0.5f), 0), (int)tex.levels.size() - 1);
+        }
+    }
+    p.index = swTriangles.size();
+    swTriangles.push_back(tri);
+    swPrimitives.push_back(p);
+}
+
+void swEmitLine(const SwVertex& v0, const SwVertex& v1) {
+    float half = max(swLineWidth, 1.0f) * 0.5f + 1.0f;
+    SwPrimitive p;
+    if (!swPrimitiveBase(p, SW_LINE, min(v0.x, v1.x) - half, min(v0.y, v1.y) - half, max(v0.x, v1.x) + half,
+                         max(v0.y, v1.y) + half)) return;
+    p.smooth = swLineSmooth;
+    p.size = max(swLineWidth, 1.0f);
+    p.index = swVertices.size();
+    swVertices.push_back(v0);
+    swVertices.push_back(v1);
+    swPrimitives.push_back(p);
+}
+
+void swEmitPoint(const SwVertex& v) {
+    float half = max(swPointSize, 1.0f) * 0.5f + 1.0f;
+    SwPrimitive p;
+    if (!swPrimitiveBase(p, SW_POINT, v.x - half, v.y - half, v.x + half, v.y + half)) return;
+    p.smooth = swPointSmooth;
+    p.size = max(swPointSize, 1.0f);
+    p.index = swVertices.size();
+    swVertices.push_back(v);
+    swPrimitives.push_back(p);
+}
+
+void swAssemble(GLenum mode, const vector<SwVertex>& v) {
+    int n = v.size();
+    switch (mode) {
+        case GL_POINTS:
+            for (int i = 0; i < n; i++) swEmitPoint(v[i]);
+            break;
+        case GL_LINES:
+            for (int i = 0; i + 1 < n; i += 2) swEmitLine(v[i], v[i + 1]);
+            break;
+        case GL_LINE_STRIP:
+        case GL_LINE_LOOP:
+            for (int i = 0; i + 1 < n; i++) swEmitLine(v[i], v[i + 1]);
+            if (mode == GL_LINE_LOOP && n > 2) swEmitLine(v[n - 1], v[0]);
+            break;
+        case GL_TRIANGLES:
+            for (int i = 0; i + 2 < n; i += 3) swEmitTriangle(v[i], v[i + 1], v[i + 2]);
+            break;
+        case GL_TRIANGLE_STRIP:
+            for (int i = 0; i + 2 < n; i++) swEmitTriangle(v[i], v[i + 1], v[i + 2]);
+            break;
+        case GL_TRIANGLE_FAN:
+        case GL_POLYGON:
+            for (int i = 1; i + 1 < n; i++) swEmitTriangle(v[0], v[i], v[i + 1]);
+            break;
+        case GL_QUADS:
+            for (int i = 0; i + 3 < n; i += 4) {
+                swEmitTriangle(v[i], v[i + 1], v[i + 2]);
+                swEmitTriangle(v[i], v[i + 2], v[i + 3]);
+            }
+            break;
+        case GL_QUAD_STRIP:
+            for (int i = 0; i + 3 < n; i += 2) {
+                swEmitTriangle(v[i], v[i + 1], v[i + 3]);
+                swEmitTriangle(v[i], v[i + 3], v[i + 2]);
+            }
+            break;
+    }
+}
+
+void swBegin(GLenum mode) {
+    swBeginMode = mode;
+    swBatch.clear();
+}
+
+void swVertex2f(float x, float y) {
+    swBatch.push_back(swWindowVertex(x, y, 0.0f, 0.0f, swCurrentColor));
+}
+
+void swEnd() {
+    swAssemble(swBeginMode, swBatch);
+}
+
+
+SwArray* swArrayFor(GLenum array) {
+    if (array == GL_VERTEX_ARRAY) return &swVertexArray;
+    if (array == GL_COLOR_ARRAY) return &swColorArray;
+    if (array == GL_TEXTURE_COORD_ARRAY) return &swTexCoordArray;
+    return nullptr;
+}
+
+void swEnableClientState(GLenum array) {
+    if (SwArray* a = swArrayFor(array)) a->enabled = true;
+}
+
+void swDisableClientState(GLenum array) {
+    if (SwArray* a = swArrayFor(array)) a->enabled = false;
+}
+
+void swSetArray(SwArray& a, int size, GLenum type, int stride, const void* pointer) {
+    int bytes = type == GL_UNSIGNED_BYTE ? 1 : 4;
+    a.size = size;
+    a.type = type;
+    a.stride = stride ? stride : size * bytes;
+    a.pointer = (const unsigned char*)pointer;
+}
+
+void swVertexPointer(int size, GLenum type, int stride, const void* p) {
+    swSetArray(swVertexArray, size, type, stride, p);
+}
+
+void swColorPointer(int size, GLenum type, int stride, const void* p) {
+    swSetArray(swColorArray, size, type, stride, p);
+}
+
+void swTexCoordPointer(int size, GLenum type, int stride, const void* p) {
+    swSetArray(swTexCoordArray, size, type, stride, p);
+}
+
+void swFetch(int i) {
+    const float* xy = (const float*)(swVertexArray.pointer + (size_t)i * swVertexArray.stride);
+    float color[4] = {swCurrentColor[0], swCurrentColor[1], swCurrentColor[2], swCurrentColor[3]};
+    if (swColorArray.enabled) {
+        const unsigned char* c = swColorArray.pointer + (size_t)i * swColorArray.stride;
+        for (int k = 0; k < swColorArray.size; k++) {
+            color[k] = swColorArray.type == GL_UNSIGNED_BYTE ? c[k] / 255.0f : ((const float*)c)[k];
+        }
+    }
+    float s = 0.0f, t = 0.0f;
+    if (swTexCoordArray.enabled) {
+        const float* st = (const float*)(swTexCoordArray.pointer + (size_t)i * swTexCoordArray.stride);
+        s = st[0];
+        t = st[1];
+    }
+    swBatch.push_back(swWindowVertex(xy[0], xy[1], s, t, color));
+}
+
+void swDrawArrays(GLenum mode, int first, int count) {
+    if (!swVertexArray.enabled) return;
+    swBatch.clear();
+    for (int i = first; i < first + count; i++) swFetch(i);
+    swAssemble(mode, swBatch);
+}
+
+void swDrawElements(GLenum mode, int count, GLenum type, const void* indices) {
+    if (!swVertexArray.enabled) return;
+    swBatch.clear();
+    for (int i = 0; i < count; i++) {
+        if (type == GL_UNSIGNED_SHORT) swFetch(((const unsigned short*)indices)[i]);
+        else if (type == GL_UNSIGNED_INT) swFetch(((const unsigned int*)indices)[i]);
+        else swFetch(((const unsigned char*)indices)[i]);
+    }
+    swAssemble(mode, swBatch);
+}
+
+void swGenTextures(int n, GLuint* names) {
+    for (int i = 0; i < n; i++) {
+        swTextures.push_back(SwTexture{{}, {}, {}, GL_REPEAT, GL_REPEAT});
+        names[i] = swTextures.size();
+    }
+}
+
+void swBindTexture(GLenum, GLuint name) {
+    swBoundTexture = name;
+}
+
+void swTexParameteri(GLenum, GLenum name, GLint value) {
+    if (swBoundTexture <= 0 || swBoundTexture > (int)swTextures.size()) return;
+    if (name == GL_TEXTURE_WRAP_S) swTextures[swBoundTexture - 1].wrapS = value;
+    if (name == GL_TEXTURE_WRAP_T) swTextures[swBoundTexture - 1].wrapT = value;
+}
+
+int swBuild2DMipmaps(GLenum, GLint, int width, int height, GLenum, GLenum, const void* data) {
+    if (swBoundTexture <= 0 || swBoundTexture > (int)swTextures.size()) return 0;
+    SwTexture& tex = swTextures[swBoundTexture - 1];
+    const unsigned char* src = (const unsigned char*)data;
+    tex.levels.assign(1, vector<unsigned char>(src, src + (size_t)width * height * 4));
+    tex.widths.assign(1, width);
+    tex.heights.assign(1, height);
+    while (width > 1 || height > 1) {
+        int w = max(1, width / 2), h = max(1, height / 2);
+        const vector<unsigned char>& prev = tex.levels.back();
+        vector<unsigned char> level((size_t)w * h * 4);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                int x0 = min(x * 2, width - 1), x1 = min(x * 2 + 1, width - 1);
+                int y0 = min(y * 2, height - 1), y1 = min(y * 2 + 1, height - 1);
+                for (int k = 0; k < 4; k++) {
+                    int sum = prev[(y0 * width + x0) * 4 + k] + prev[(y0 * width + x1) * 4 + k] +
+                              prev[(y1 * width + x0) * 4 + k] + prev[(y1 * width + x1) * 4 + k];
+                    level[(y * w + x) * 4 + k] = (sum + 2) / 4;
+                }
+            }
+        }
+        tex.levels.push_back(move(level));
+        tex.widths.push_back(w);
+        tex.heights.push_back(h);
+        width = w;
+        height = h;
+    }
+    return 0;
+}
+
+void swRasterPos2f(float x, float y) {
+    SwVertex v = swWindowVertex(x, y, 0.0f, 0.0f, swCurrentColor);
+    swRasterX = v.x;
+    swRasterY = v.y;
+    swRasterValid = v.x >= swViewport[0] && v.x <= swViewport[0] + swViewport[2] && v.y >= swViewport[1] &&
+                    v.y <= swViewport[1] + swViewport[3];
+    memcpy(swRasterColor, swCurrentColor, sizeof(swRasterColor));
+}
+
+void swBitmapCharacter(void*, int character) {
+    if (swRasterValid && character > 32 && character < 127) {
+        float left = floor(swRasterX), bottom = floor(swRasterY);
+        SwPrimitive p;
+        if (swPrimitiveBase(p, SW_BITMAP, left, bottom, left + 4, bottom + 6)) {
+            p.bitmap = &swFont[(character - 32) * 5];
+            p.index = swVertices.size();
+            SwVertex v = {left, bottom, 0.0f, 0.0f, {swRasterColor[0], swRasterColor[1], swRasterColor[2], swRasterColor[3]}};
+            swVertices.push_back(v);
+            swPrimitives.push_back(p);
+        }
+    }
+    swRasterX += 6;
+}
+
+void swClear(GLbitfield mask) {
+    if (!(mask & GL_COLOR_BUFFER_BIT)) return;
+    SwPrimitive p;
+    int viewport[4];
+    memcpy(viewport, swViewport, sizeof(viewport));
+    swViewportSet(0, 0, swWidth, swHeight);
+    bool ok = swPrimitiveBase(p, SW_CLEAR, 0, 0, swWidth, swHeight);
+    memcpy(swViewport, viewport, sizeof(viewport));
+    if (!ok) return;
+    p.index = swVertices.size();
+    SwVertex v = {0, 0, 0, 0, {swClearColor[0], swClearColor[1], swClearColor[2], swClearColor[3]}};
+    swVertices.push_back(v);
+    swPrimitives.push_back(p);
+}
+
+float swFactor(GLenum factor, float alpha) {
+    switch (factor) {
+        case GL_ZERO: return 0.0f;
+        case GL_SRC_ALPHA: return alpha;
+        case GL_ONE_MINUS_SRC_ALPHA: return 1.0f - alpha;
+        default: return 1.0f;
+    }
+}
+
+inline void swBlendPixel(float* dst, const float* src, float coverage, const SwPrimitive& p) {
+    float alpha = src[3] * coverage;
+    float sf = swFactor(p.src, alpha), df = swFactor(p.dst, alpha);
+#if defined(__SSE2__)
+    __m128 s = _mm_set_ps(alpha, src[2], src[1], src[0]);
+    __m128 d = _mm_loadu_ps(dst);
+    d = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(sf)), _mm_mul_ps(d, _mm_set1_ps(df)));
+    _mm_storeu_ps(dst, _mm_min_ps(_mm_max_ps(d, _mm_setzero_ps()), _mm_set1_ps(1.0f)));
+#else
+    for (int k = 0; k < 4; k++) {
+        float s = k == 3 ? alpha : src[k];
+        dst[k] = min(max(s * sf + dst[k] * df, 0.0f), 1.0f);
+    }
+#endif
+}
+
+void swSample(const SwTexture& tex, int level, float s, float t, float* out) {
+    int w = tex.widths[level], h = tex.heights[level];
+    const unsigned char* texels = tex.levels[level].data();
+    float u = s * w - 0.5f, v = t * h - 0.5f;
+    int x0 = (int)floor(u), y0 = (int)floor(v);
+    float fu = u - x0, fv = v - y0;
+    auto wrap = [](int i, int n, GLint mode) {
+        if (mode == GL_REPEAT) return ((i % n) + n) % n;
+        return min(max(i, 0), n - 1);
+    };
+    int xa = wrap(x0, w, tex.wrapS), xb = wrap(x0 + 1, w, tex.wrapS);
+    int ya = wrap(y0, h, tex.wrapT), yb = wrap(y0 + 1, h, tex.wrapT);
+    const unsigned char* t00 = texels + (ya * w + xa) * 4;
+    const unsigned char* t10 = texels + (ya * w + xb) * 4;
+    const unsigned char* t01 = texels + (yb * w + xa) * 4;
+    const unsigned char* t11 = texels + (yb * w + xb) * 4;
+    float w00 = (1 - fu) * (1 - fv), w10 = fu * (1 - fv), w01 = (1 - fu) * fv, w11 = fu * fv;
+    for (int k = 0; k < 4; k++) {
+        out[k] = (t00[k] * w00 + t10[k] * w10 + t01[k] * w01 + t11[k] * w11) * (1.0f / 255.0f);
+    }
+}
+
+void swRasterTriangle(const SwPrimitive& p, int x0, int y0, int x1, int y1) {
+    const SwTriangle& tri = swTriangles[p.index];
+    const SwTexture* tex = p.texture >= 0 ? &swTextures[p.texture] : nullptr;
+    long long step[3] = {tri.a[0] * 256, tri.a[1] * 256, tri.a[2] * 256};
+    for (int y = y0; y < y1; y++) {
+        long long py = (long long)y * 256 + 128, px = (long long)x0 * 256 + 128;
+        long long e0 = tri.a[0] * px + tri.b[0] * py + tri.c[0];
+        long long e1 = tri.a[1] * px + tri.b[1] * py + tri.c[1];
+        long long e2 = tri.a[2] * px + tri.b[2] * py + tri.c[2];
+        int x = x0;
+        while (x < x1 && (e0 | e1 | e2) < 0) {
+            x++;
+            e0 += step[0];
+            e1 += step[1];
+            e2 += step[2];
+        }
+        int start = x;
+        while (x < x1 && (e0 | e1 | e2) >= 0) {
+            x++;
+            e0 += step[0];
+            e1 += step[1];
+            e2 += step[2];
+        }
+        if (start == x) continue;
+
+        float fx = start + 0.5f - tri.x0, fy = y + 0.5f - tri.y0;
+        float color[4];
+        for (int k = 0; k < 4; k++) color[k] = tri.color[k] + tri.colorDx[k] * fx + tri.colorDy[k] * fy;
+        float s = tri.s + tri.sDx * fx + tri.sDy * fy, t = tri.t + tri.tDx * fx + tri.tDy * fy;
+        float* dst = &swColor[((size_t)y * swWidth + start) * 4];
+        for (int i = start; i < x; i++, dst += 4) {
+            float src[4];
+            if (tex) {
+                swSample(*tex, tri.level, s, t, src);
+                for (int k = 0; k < 4; k++) src[k] *= color[k];
+                s += tri.sDx;
+                t += tri.tDx;
+            } else {
+                memcpy(src, color, sizeof(src));
+            }
+            swBlendPixel(dst, src, 1.0f, p);
+            for (int k = 0; k < 4; k++) color[k] += tri.colorDx[k];
+        }
+    }
+}
+
+void swRasterLine(const SwPrimitive& p, int x0, int y0, int x1, int y1) {
+    const SwVertex& a = swVertices[p.index];
+    const SwVertex& b = swVertices[p.index + 1];
+    float dx = b.x - a.x, dy = b.y - a.y, len = sqrt(dx * dx + dy * dy);
+    if (len < 1e-6f) return;
+    float ux = dx / len, uy = dy / len, half = p.size * 0.5f;
+    for (int y = y0; y < y1; y++) {
+        float* dst = &swColor[((size_t)y * swWidth + x0) * 4];
+        for (int x = x0; x < x1; x++, dst += 4) {
+            float rx = x + 0.5f - a.x, ry = y + 0.5f - a.y;
+            float along = rx * ux + ry * uy, across = ry * ux - rx * uy;
+            float coverage;
+            if (p.smooth) {
+                coverage = min(max(half + 0.5f - fabs(across), 0.0f), 1.0f) *
+                           min(max(min(along, len - along) + 0.5f, 0.0f), 1.0f);
+            } else {
+                coverage = across >= -half && across < half && along >= 0.0f && along < len ? 1.0f : 0.0f;
+            }
+            if (coverage <= 0.0f) continue;
+            float f = min(max(along / len, 0.0f), 1.0f), src[4];
+            for (int k = 0; k < 4; k++) src[k] = a.color[k] + (b.color[k] - a.color[k]) * f;
+            swBlendPixel(dst, src, coverage, p);
+        }
+    }
+}
+
+void swRasterPoint(const SwPrimitive& p, int x0, int y0, int x1, int y1) {
+    const SwVertex& v = swVertices[p.index];
+    float radius = p.size * 0.5f;
+    for (int y = y0; y < y1; y++) {
+        float* dst = &swColor[((size_t)y * swWidth + x0) * 4];
+        for (int x = x0; x < x1; x++, dst += 4) {
+            float rx = x + 0.5f - v.x, ry = y + 0.5f - v.y, coverage;
+            if (p.smooth) coverage = min(max(radius + 0.5f - sqrt(rx * rx + ry * ry), 0.0f), 1.0f);
+            else coverage = rx >= -radius && rx < radius && ry >= -radius && ry < radius ? 1.0f : 0.0f;
+            if (coverage > 0.0f) swBlendPixel(dst, v.color, coverage, p);
+        }
+    }
+}
+
+void swRasterBitmap(const SwPrimitive& p, int x0, int y0, int x1, int y1) {
+    const SwVertex& v = swVertices[p.index];
+    int left = (int)v.x, top = (int)v.y + 6;
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            if ((p.bitmap[x - left] >> (top - y)) & 1) swBlendPixel(&swColor[((size_t)y * swWidth + x) * 4], v.color, 1.0f, p);
+        }
+    }
+}
+
+void swRasterTile(int tile) {
+    int tilesX = (swWidth + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    int tx0 = (tile % tilesX) * SW_TILE_SIZE, ty0 = (tile / tilesX) * SW_TILE_SIZE;
+    int tx1 = min(tx0 + SW_TILE_SIZE, swWidth), ty1 = min(ty0 + SW_TILE_SIZE, swHeight);
+    for (int k = swBinStart[tile]; k < swBinStart[tile + 1]; k++) {
+        const SwPrimitive& p = swPrimitives[swBinItems[k]];
+        int x0 = max(p.x0, tx0), y0 = max(p.y0, ty0), x1 = min(p.x1, tx1), y1 = min(p.y1, ty1);
+        if (x0 >= x1 || y0 >= y1) continue;
+        switch (p.kind) {
+            case SW_TRIANGLE: swRasterTriangle(p, x0, y0, x1, y1); break;
+            case SW_LINE: swRasterLine(p, x0, y0, x1, y1); break;
+            case SW_POINT: swRasterPoint(p, x0, y0, x1, y1); break;
+            case SW_BITMAP: swRasterBitmap(p, x0, y0, x1, y1); break;
+            case SW_CLEAR:
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) memcpy(&swColor[((size_t)y * swWidth + x) * 4], swVertices[p.index].color, 16);
+                }
+                break;
+        }
+    }
+    for (int y = ty0; y < ty1; y++) {
+        const float* src = &swColor[((size_t)y * swWidth + tx0) * 4];
+        unsigned char* dst = &swPixels[((size_t)y * swWidth + tx0) * 4];
+        for (int i = 0; i < (tx1 - tx0) * 4; i++) dst[i] = (unsigned char)(src[i] * 255.0f + 0.5f);
+    }
+}
+
+void swFlush() {
+    if (swPrimitives.empty()) return;
+    auto start = chrono::steady_clock::now();
+    int tilesX = (swWidth + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    int tiles = swBinStart.size() - 1;
+    fill(swBinStart.begin(), swBinStart.end(), 0);
+    for (const SwPrimitive& p : swPrimitives) {
+        for (int ty = p.y0 / SW_TILE_SIZE; ty <= (p.y1 - 1) / SW_TILE_SIZE; ty++) {
+            for (int tx = p.x0 / SW_TILE_SIZE; tx <= (p.x1 - 1) / SW_TILE_SIZE; tx++) swBinStart[ty * tilesX + tx + 1]++;
+        }
+    }
+    for (int t = 0; t < tiles; t++) swBinStart[t + 1] += swBinStart[t];
+    swBinItems = arenaArray<int>(swBinStart[tiles]);
+    int* cursor = arenaArray<int>(tiles);
+    memcpy(cursor, swBinStart.data(), tiles * sizeof(int));
+    for (int i = 0; i < (int)swPrimitives.size(); i++) {
+        const SwPrimitive& p = swPrimitives[i];
+        for (int ty = p.y0 / SW_TILE_SIZE; ty <= (p.y1 - 1) / SW_TILE_SIZE; ty++) {
+            for (int tx = p.x0 / SW_TILE_SIZE; tx <= (p.x1 - 1) / SW_TILE_SIZE; tx++) swBinItems[cursor[ty * tilesX + tx]++] = i;
+        }
+    }
+
+    atomic<int> next(0);
+    runParallel(min(swThreads, tiles), [&](int) {
+        for (int tile = next++; tile < tiles; tile = next++) swRasterTile(tile);
+    });
+
+    swPrimitives.clear();
+    swTriangles.clear();
+    swVertices.clear();
+    swFlushCount++;
+    swFlushMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void swReadPixels(int x, int y, int width, int height, GLenum format, GLenum, void* pixels) {
+    swFlush();
+    if (!pixels) return;
+    int channels = format == GL_RGB ? 3 : 4;
+    unsigned char* out = (unsigned char*)pixels;
+    for (int row = 0; row < height; row++) {
+        const unsigned char* src = &swPixels[((size_t)(y + row) * swWidth + x) * 4];
+        for (int i = 0; i < width; i++, out += channels) memcpy(out, src + i * 4, channels);
+    }
+}
+
+int swGet(GLenum what) {
+    if (what == GLUT_WINDOW_WIDTH) return swWidth;
+    if (what == GLUT_WINDOW_HEIGHT) return swHeight;
+    return 0;
+}
+
+// Every GL entry point the drawing code uses goes to the software rasterizer when it is active.
+#define glBegin(mode) (softwareRender ? swBegin(mode) : glBegin(mode))
+#define glEnd() (softwareRender ? swEnd() : glEnd())
+#define glVertex2f(x, y) (softwareRender ? swVertex2f(x, y) : glVertex2f(x, y))
+#define glColor3f(r, g, b) (softwareRender ? swColor3f(r, g, b) : glColor3f(r, g, b))
+#define glColor4f(r, g, b, a) (softwareRender ? swColor4f(r, g, b, a) : glColor4f(r, g, b, a))
+#define glPointSize(size) (softwareRender ? swPointSizeSet(size) : glPointSize(size))
+#define glLineWidth(width) (softwareRender ? swLineWidthSet(width) : glLineWidth(width))
+#define glEnable(cap) (softwareRender ? swEnable(cap) : glEnable(cap))
+#define glDisable(cap) (softwareRender ? swDisable(cap) : glDisable(cap))
+#define glBlendFunc(src, dst) (softwareRender ? swBlendFunc(src, dst) : glBlendFunc(src, dst))
+#define glHint(target, mode) (softwareRender ? swIgnore() : glHint(target, mode))
+#define glMatrixMode(mode) (softwareRender ? swMatrixModeSet(mode) : glMatrixMode(mode))
+#define glLoadIdentity() (softwareRender ? swLoadIdentity() : glLoadIdentity())
+#define glPushMatrix() (softwareRender ? swPushMatrix() : glPushMatrix())
+#define glPopMatrix() (softwareRender ? swPopMatrix() : glPopMatrix())
+#define glTranslatef(x, y, z) (softwareRender ? swTranslatef(x, y, z) : glTranslatef(x, y, z))
+#define glRotatef(a, x, y, z) (softwareRender ? swRotatef(a, x, y, z) : glRotatef(a, x, y, z))
+#define glScalef(x, y, z) (softwareRender ? swScalef(x, y, z) : glScalef(x, y, z))
+#define glOrtho(l, r, b, t, n, f) (softwareRender ? swOrtho(l, r, b, t, n, f) : glOrtho(l, r, b, t, n, f))
+#define glViewport(x, y, w, h) (softwareRender ? swViewportSet(x, y, w, h) : glViewport(x, y, w, h))
+#define glScissor(x, y, w, h) (softwareRender ? swScissorSet(x, y, w, h) : glScissor(x, y, w, h))
+#define glClearColor(r, g, b, a) (softwareRender ? swClearColorSet(r, g, b, a) : glClearColor(r, g, b, a))
+#define glClear(mask) (softwareRender ? swClear(mask) : glClear(mask))
+#define glEnableClientState(a) (softwareRender ? swEnableClientState(a) : glEnableClientState(a))
+#define glDisableClientState(a) (softwareRender ? swDisableClientState(a) : glDisableClientState(a))
+#define glVertexPointer(n, t, s, p) (softwareRender ? swVertexPointer(n, t, s, p) : glVertexPointer(n, t, s, p))
+#define glColorPointer(n, t, s, p) (softwareRender ? swColorPointer(n, t, s, p) : glColorPointer(n, t, s, p))
+#define glTexCoordPointer(n, t, s, p) (softwareRender ? swTexCoordPointer(n, t, s, p) : glTexCoordPointer(n, t, s, p))
+#define glDrawArrays(m, f, c) (softwareRender ? swDrawArrays(m, f, c) : glDrawArrays(m, f, c))
+#define glDrawElements(m, c, t, i) (softwareRender ? swDrawElements(m, c, t, i) : glDrawElements(m, c, t, i))
+#define glGenTextures(n, names) (softwareRender ? swGenTextures(n, names) : glGenTextures(n, names))
+#define glBindTexture(target, name) (softwareRender ? swBindTexture(target, name) : glBindTexture(target, name))
+#define glTexParameteri(target, name, v) (softwareRender ? swTexParameteri(target, name, v) : glTexParameteri(target, name, v))
+#define gluBuild2DMipmaps(t, i, w, h, f, y, d) (softwareRender ? swBuild2DMipmaps(t, i, w, h, f, y, d) : gluBuild2DMipmaps(t, i, w, h, f, y, d))
+#define glRasterPos2f(x, y) (softwareRender ? swRasterPos2f(x, y) : glRasterPos2f(x, y))
+#define glutBitmapCharacter(font, c) (softwareRender ? swBitmapCharacter(font, c) : glutBitmapCharacter(font, c))
+#define glReadBuffer(mode) (softwareRender ? swIgnore() : glReadBuffer(mode))
+#define glPixelStorei(name, v) (softwareRender ? swIgnore() : glPixelStorei(name, v))
+#define glReadPixels(x, y, w, h, f, t, p) (softwareRender ? swReadPixels(x, y, w, h, f, t, p) : glReadPixels(x, y, w, h, f, t, p))
+#define glutSwapBuffers() (softwareRender ? swFlush() : glutSwapBuffers())
+#define glutGet(what) (softwareRender ? swGet(what) : glutGet(what))
+
+
+
+void drawCircle(float x, float y, float r, int seg, bool line = false) {
+    if (line) {
+        glBegin(GL_LINE_LOOP);
+    } else {
+        glBegin(GL_TRIANGLE_FAN);
+        glVertex2f(x, y);
+    }
+    for (int i = 0; i <= seg; i++) {
+        float theta = 2.0f * PI * i / seg;
+        glVertex2f(x + r * cos(theta), y + r * sin(theta));
+    }
+    glEnd();
+}
+
+void drawEllipse(float x, float y, float rx, float ry, int seg, bool line = false) {
+    if (line) {
+        glBegin(GL_LINE_LOOP);
+    } else {
+        glBegin(GL_TRIANGLE_FAN);
+        glVertex2f(x, y);
+    }
+    for (int i = 0; i <= seg; i++) {
+        float theta = 2.0f * PI * i / seg;
+        glVertex2f(x + rx * cos(theta), y + ry * sin(theta));
+    }
+    glEnd();
+}
+
+void drawGlow(float x, float y, float r, float red, float green, float blue, float intensity = 0.3f) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    const QualityTier& q = qualityTiers[qualityTier];
+    int layers = q.glowLayers;
+    for (int i = 0; i < layers; i++) {
+        float ratio = (float)i / layers;
+        float currentR = r * (1.0f + ratio * 1.5f);
+        float alpha = (1.0f - ratio) * intensity * 15.0f / layers;
+        glColor4f(red, green, blue, alpha);
+        drawCircle(x, y, currentR, q.glowSegments);
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+
+void drawSunRays(float x, float y, float r, float rotationOffset) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    int numRays = 16;
+    for (int i = 0; i < numRays; i++) {
+        float angle = (2.0f * PI * i / numRays) + rotationOffset;
+        glBegin(GL_TRIANGLES);
+        glColor4f(1.0f, 0.9f, 0.5f, 0.6f);
+        glVertex2f(x + r * cos(angle - 0.05f), y + r * sin(angle - 0.05f));
+        glVertex2f(x + r * cos(angle + 0.05f), y + r * sin(angle + 0.05f));
+        glColor4f(1.0f, 0.7f, 0.0f, 0.0f);
+        glVertex2f(x + r * 2.5f * cos(angle), y + r * 2.5f * sin(angle));
+        glEnd();
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+
+void drawCorona(float x, float y, float r, float angle) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    const QualityTier& q = qualityTiers[qualityTier];
+    for (int ring = 0; ring < q.coronaRings; ring++) {
+        float ringR = r * (1.2f + ring * 0.15f);
+        glBegin(GL_TRIANGLE_STRIP);
+        for (int i = 0; i <= q.ringSegments; i++) {
+            float theta = 2.0f * PI * i / q.ringSegments + angle + ring * 0.5f;
+            float wave = sin(theta * 5 + ring) * 0.02f;
+            float alpha = 0.15f - ring * 0.04f;
+            glColor4f(1.0f, 0.9f, 0.7f, alpha);
+            glVertex2f(x + (ringR + wave) * cos(theta), y + (ringR + wave) * sin(theta));
+            glVertex2f(x + (ringR + wave + 0.03f) * cos(theta), y + (ringR + wave + 0.03f) * sin(theta));
+        }
+        glEnd();
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void drawHeatwave(float x, float y, float baseR, float phase) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    const QualityTier& q = qualityTiers[qualityTier];
+    for (int i = 0; i < q.heatwaveLoops; i++) {
+        float offset = i * 0.8f;
+        glBegin(GL_LINE_LOOP);
+        for (int j = 0; j <= q.ringSegments; j++) {
+            float theta = 2.0f * PI * j / q.ringSegments;
+            float wave = sin(theta * 3 + phase + offset) * 0.015f;
+            float r = baseR * (1.05f + i * 0.05f) + wave;
+            float alpha = (0.15f - i * 0.02f) * (1.0f + 0.3f * sin(phase * 2 + i));
+            glColor4f(1.0f, 0.8f, 0.4f, alpha);
+            glVertex2f(x + r * cos(theta), y + r * sin(theta));
+        }
+        glEnd();
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+
+void drawSunspots(float x, float y, float r, float rotation) {
+    glEnable(GL_BLEND);
+
+    float spotData[][3] = {
+        {0.3f, 0.4f, 0.12f},
+        {-0.5f, -0.2f, 0.08f},
+        {0.1f, -0.6f, 0.1f},
+        {-0.3f, 0.5f, 0.06f}
+    };
+
+    glPushMatrix();
+    glTranslatef(x, y, 0);
+    glRotatef(rotation, 0, 0, 1);
+
+    for (int i = 0; i < 4; i++) {
+        float sx = r * spotData[i][0];
+        float sy = r * spotData[i][1];
+        float sr = r * spotData[i][2];
+        
+        glColor4f(0.3f, 0.2f, 0.0f, 0.7f);
+        drawCircle(sx, sy, sr, 20);
+        glColor4f(0.2f, 0.1f, 0.0f, 0.5f);
+        drawCircle(sx, sy, sr * 0.6f, 15);
+    }
+
+    glPopMatrix();
+}
+
+void drawSolarFlares(float x, float y, float r, float time) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    int numFlares = 3;
+    for (int i = 0; i < numFlares; i++) {
+        float angle = (2.0f * PI * i / numFlares) + time * 0.05f;
+        float flareIntensity = 0.5f + 0.5f * sin(time * 0.3f + i * 2);
+        float flareLength = r * (0.3f + 0.2f * flareIntensity);
+        
+        glBegin(GL_TRIANGLES);
+        glColor4f(1.0f, 0.9f, 0.7f, 0.4f * flareIntensity);
+        glVertex2f(x + r * cos(angle - 0.1f), y + r * sin(angle - 0.1f));
+        glVertex2f(x + r * cos(angle + 0.1f), y + r * sin(angle + 0.1f));
+        glColor4f(1.0f, 0.5f, 0.0f, 0.0f);
+        glVertex2f(x + (r + flareLength) * cos(angle), y + (r + flareLength) * sin(angle));
+        glEnd();
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void drawRing(float x, float y, float innerR, float outerR, int seg, float r, float g, float b, float a) {
+    glEnable(GL_BLEND);
+    glBegin(GL_QUAD_STRIP);
+    for (int i = 0; i <= seg; i++) {
+        float theta = 2.0f * PI * i / seg;
+        glColor4f(r, g, b, a);
+        glVertex2f(x + innerR * cos(theta), y + innerR * sin(theta));
+        glVertex2f(x + outerR * cos(theta), y + outerR * sin(theta));
+    }
+    glEnd();
+}
+
+void drawAnimatedRing(float x, float y, float innerR, float outerR, int seg,
+                      float r, float g, float b, float a, float rotation) {
+    glEnable(GL_BLEND);
+    glPushMatrix();
+    glTranslatef(x, y, 0);
+    glRotatef(rotation, 0, 0, 1);
+
+    glBegin(GL_QUAD_STRIP);
+    for (int i = 0; i <= seg; i++) {
+        float theta = 2.0f * PI * i / seg;
+        glColor4f(r, g, b, a * (0.8f + 0.2f * sin(theta * 5)));
+        glVertex2f(innerR * cos(theta), innerR * sin(theta));
+        glVertex2f(outerR * cos(theta), outerR * sin(theta));
+    }
+    glEnd();
+
+    glPopMatrix();
+}
+
+
+unsigned int simRandom() {
+    simRandomState ^= simRandomState << 13;
+    simRandomState ^= simRandomState >> 17;
+    simRandomState ^= simRandomState << 5;
+    return simRandomState;
+}
+
+float randomRange(float lo, float hi) {
+    return lo + (hi - lo) * (simRandom() % 10000) / 10000.0f;
+}
+
+void initParticlePool(ParticlePool& pool, int capacity, float pointSize, float streakLength,
+                      float wrapExtent, bool additive, bool fadeInOut) {
+    pool.capacity = capacity;
+    pool.count = 0;
+    for (vector<float>* field : {&pool.x, &pool.y, &pool.vx, &pool.vy, &pool.age, &pool.life,
+                                 &pool.r, &pool.g, &pool.b, &pool.a}) {
+        field->assign(capacity, 0.0f);
+    }
+    pool.pointSize = pointSize;
+    pool.streakLength = streakLength;
+    pool.wrapExtent = wrapExtent;
+    pool.additive = additive;
+    pool.fadeInOut = fadeInOut;
+}
+
+int spawnParticle(ParticlePool& pool, float x, float y, float vx, float vy, float life,
+                  float r, float g, float b, float a) {
+    if (pool.count >= pool.capacity) return -1;
+    int i = pool.count++;
+    pool.x[i] = x;
+    pool.y[i] = y;
+    pool.vx[i] = vx;
+    pool.vy[i] = vy;
+    pool.age[i] = 0.0f;
+    pool.life[i] = life;
+    pool.r[i] = r;
+    pool.g[i] = g;
+    pool.b[i] = b;
+    pool.a[i] = a;
+    return i;
+}
+
+void removeParticle(ParticlePool& pool, int i) {
+    int last = --pool.count;
+    pool.x[i] = pool.x[last];
+    pool.y[i] = pool.y[last];
+    pool.vx[i] = pool.vx[last];
+    pool.vy[i] = pool.vy[last];
+    pool.age[i] = pool.age[last];
+    pool.life[i] = pool.life[last];
+    pool.r[i] = pool.r[last];
+    pool.g[i] = pool.g[last];
+    pool.b[i] = pool.b[last];
+    pool.a[i] = pool.a[last];
+}
+
+void updateParticles(ParticlePool& pool, float dt) {
+    float extent = pool.wrapExtent;
+    int i = 0;
+    while (i < pool.count) {
+        pool.age[i] += dt;
+        if (pool.life[i] > 0 && pool.age[i] >= pool.life[i]) {
+            removeParticle(pool, i);
+            continue;
+        }
+        pool.x[i] += pool.vx[i] * dt;
+        pool.y[i] += pool.vy[i] * dt;
+        if (extent > 0) {
+            if (pool.x[i] < -extent) pool.x[i] += 2 * extent;
+            else if (pool.x[i] >= extent) pool.x[i] -= 2 * extent;
+            if (pool.y[i] < -extent) pool.y[i] += 2 * extent;
+            else if (pool.y[i] >= extent) pool.y[i] -= 2 * extent;
+        }
+        i++;
+    }
+}
+
+void runEmitter(ParticleEmitter& e, ParticlePool& pool, float dt) {
+    e.accumulator += e.rate * dt;
+    while (e.accumulator >= 1.0f) {
+        e.accumulator -= 1.0f;
+        spawnParticle(pool,
+                      e.x + randomRange(-e.spreadX, e.spreadX),
+                      e.y + randomRange(-e.spreadY, e.spreadY),
+                      e.vx + randomRange(-e.spreadV, e.spreadV),
+                      e.vy + randomRange(-e.spreadV, e.spreadV),
+                      e.life + randomRange(-e.lifeJitter, e.lifeJitter),
+                      e.r, e.g, e.b, e.a);
+    }
+}
+
+unsigned char colorByte(float v) {
+    return (unsigned char)(min(max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+void buildParticleBatch(const ParticlePool& pool, ParticleBatch& batch) {
+    bool streaks = pool.streakLength > 0;
+    int verticesPerParticle = streaks ? 2 : 1;
+    batch.vertices.reserve(pool.capacity * verticesPerParticle * 2);
+    batch.colors.reserve(pool.capacity * verticesPerParticle * 4);
+    batch.vertices.resize(pool.count * verticesPerParticle * 2);
+    batch.colors.resize(pool.count * verticesPerParticle * 4);
+    batch.count = pool.count;
+    batch.pointSize = pool.pointSize;
+    batch.streakLength = pool.streakLength;
+    batch.additive = pool.additive;
+
+    float* v = batch.vertices.data();
+    unsigned char* c = batch.colors.data();
+    for (int i = 0; i < pool.count; i++) {
+        float fade = 1.0f;
+        if (pool.life[i] > 0) {
+            float t = pool.age[i] / pool.life[i];
+            fade = pool.fadeInOut ? sin(t * PI) : 1.0f - t;
+        }
+        *v++ = pool.x[i];
+        *v++ = pool.y[i];
+        *c++ = colorByte(pool.r[i]);
+        *c++ = colorByte(pool.g[i]);
+        *c++ = colorByte(pool.b[i]);
+        *c++ = colorByte(pool.a[i] * fade);
+        if (streaks) {
+            *v++ = pool.x[i] - pool.vx[i] * pool.streakLength;
+            *v++ = pool.y[i] - pool.vy[i] * pool.streakLength;
+            *c++ = colorByte(pool.r[i] * 0.6f);
+            *c++ = colorByte(pool.g[i] * 0.6f);
+            *c++ = colorByte(pool.b[i]);
+            *c++ = 0;
+        }
+    }
+}
+
+void drawParticles(const ParticleBatch& batch, int stride = 1) {
+    if (batch.count == 0) return;
+
+    glEnable(GL_BLEND);
+    if (batch.additive) glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    if (batch.streakLength > 0) {
+        glVertexPointer(2, GL_FLOAT, 0, batch.vertices.data());
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, batch.colors.data());
+        glLineWidth(1.5f);
+        glDrawArrays(GL_LINES, 0, batch.count * 2);
+        glLineWidth(1.0f);
+        glVertexPointer(2, GL_FLOAT, 4 * sizeof(float), batch.vertices.data());
+        glColorPointer(4, GL_UNSIGNED_BYTE, 8, batch.colors.data());
+        glPointSize(batch.pointSize);
+        glDrawArrays(GL_POINTS, 0, batch.count);
+    } else {
+        glVertexPointer(2, GL_FLOAT, stride * 2 * sizeof(float), batch.vertices.data());
+        glColorPointer(4, GL_UNSIGNED_BYTE, stride * 4, batch.colors.data());
+        glPointSize(batch.pointSize);
+        glDrawArrays(GL_POINTS, 0, (batch.count + stride - 1) / stride);
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+int catalogTileCoord(float v) {
+    const CatalogHeader& h = catalogHeader;
+    int t = (int)floor((v + h.extent) * h.tilesPerSide / (2.0f * h.extent));
+    return min(max(t, 0), h.tilesPerSide - 1);
+}
+
+int catalogTileOf(float x, float y) {
+    return catalogTileCoord(y) * catalogHeader.tilesPerSide + catalogTileCoord(x);
+}
+
+void makeStarCatalog(const string& path, long long count) {
+    catalogHeader = {{'S', 'S', 'E', 'C', 'A', 'T', '1', 0}, 64, CATALOG_MAG_STEPS, 1.5f, CATALOG_MAG_STEP, count};
+    const CatalogHeader& h = catalogHeader;
+    srand(12345);
+    auto uniform = [] { return (rand() + 1.0f) / (RAND_MAX + 1.0f); };
+
+    vector<CatalogStar> all(count);
+    for (auto& s : all) {
+        do {
+            if (uniform() < 0.35f) {
+                float along = (uniform() * 2.0f - 1.0f) * h.extent * 1.5f;
+                float across = 0.15f * sqrt(-2.0f * log(uniform())) * cos(2.0f * PI * uniform());
+                s.x = along * 0.906f - across * 0.423f;
+                s.y = along * 0.423f + across * 0.906f;
+            } else {
+                s.x = (uniform() * 2.0f - 1.0f) * h.extent;
+                s.y = (uniform() * 2.0f - 1.0f) * h.extent;
+            }
+        } while (fabs(s.x) >= h.extent || fabs(s.y) >= h.extent);
+        s.magnitude = max(0.0f, 15.5f + log10(uniform()) / 0.35f);
+        s.twinkleSpeed = 0.5f + (rand() % 15) / 10.0f;
+    }
+    sort(all.begin(), all.end(), [](const CatalogStar& a, const CatalogStar& b) {
+        int ta = catalogTileOf(a.x, a.y), tb = catalogTileOf(b.x, b.y);
+        return ta != tb ? ta < tb : a.magnitude < b.magnitude;
+    });
+
+    int tileCount = h.tilesPerSide * h.tilesPerSide;
+    vector<CatalogTileEntry> index(tileCount);
+    long long offset = sizeof(CatalogHeader) + tileCount * sizeof(CatalogTileEntry);
+    size_t next = 0;
+    for (int t = 0; t < tileCount; t++) {
+        CatalogTileEntry& e = index[t];
+        memset(&e, 0, sizeof(e));
+        e.offset = offset + next * sizeof(CatalogStar);
+        while (next + e.count < all.size() && catalogTileOf(all[next + e.count].x, all[next + e.count].y) == t) {
+            int step = min((int)(all[next + e.count].magnitude / CATALOG_MAG_STEP), CATALOG_MAG_STEPS - 1);
+            e.cumulative[step]++;
+            e.count++;
+        }
+        for (int k = 1; k < CATALOG_MAG_STEPS; k++) e.cumulative[k] += e.cumulative[k - 1];
+        next += e.count;
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        cerr << "Cannot write star catalog " << path << endl;
+        exit(1);
+    }
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(index.data(), sizeof(CatalogTileEntry), tileCount, f);
+    fwrite(all.data(), sizeof(CatalogStar), all.size(), f);
+    fclose(f);
+    cout << "Wrote " << count << " stars in " << tileCount << " tiles to " << path << endl;
+}
+
+void catalogLoaderLoop() {
+    FILE* f = fopen(catalogPath.c_str(), "rb");
+    if (!f) {
+        cerr << "Cannot reopen star catalog " << catalogPath << ", no more tiles will load" << endl;
+        lock_guard<mutex> lock(catalogMutex);
+        catalogStopping = true;
+        catalogRequests.clear();
+        return;
+    }
+    vector<CatalogStar> buffer;
+    while (true) {
+        int tile, want;
+        {
+            unique_lock<mutex> lock(catalogMutex);
+            catalogCondition.wait(lock, [] { return catalogStopping || !catalogRequests.empty(); });
+            if (catalogStopping) break;
+            tile = catalogRequests.back();
+            catalogRequests.pop_back();
+            CatalogTile& t = catalogTiles[tile];
+            if (t.lastUsed < catalogFrame - 2) t.requested = t.stars.size();
+            want = t.requested;
+            if ((int)t.stars.size() >= want) continue;
+        }
+
+        buffer.resize(want);
+        fseek(f, catalogIndex[tile].offset, SEEK_SET);
+        buffer.resize(fread(buffer.data(), sizeof(CatalogStar), want, f));
+
+        lock_guard<mutex> lock(catalogMutex);
+        CatalogTile& t = catalogTiles[tile];
+        if (buffer.size() > t.stars.size()) {
+            catalogResident += buffer.size() - t.stars.size();
+            t.stars.swap(buffer);
+        }
+        while (catalogResident > catalogCacheBudget) {
+            int oldest = -1;
+            for (int i = 0; i < (int)catalogTiles.size(); i++) {
+                const CatalogTile& c = catalogTiles[i];
+                if (c.stars.empty() || c.lastUsed >= catalogFrame) continue;
+                if (oldest < 0 || c.lastUsed < catalogTiles[oldest].lastUsed) oldest = i;
+            }
+            if (oldest < 0) break;
+            catalogResident -= catalogTiles[oldest].stars.size();
+            vector<CatalogStar>().swap(catalogTiles[oldest].stars);
+            catalogTiles[oldest].requested = 0;
+        }
+    }
+    fclose(f);
+}
+
+bool openStarCatalog(const string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        cerr << "Cannot open star catalog " << path << endl;
+        return false;
+    }
+    CatalogHeader& h = catalogHeader;
+    bool valid = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, "SSECAT1", 8) == 0 &&
+                 h.magSteps == CATALOG_MAG_STEPS && h.tilesPerSide > 0;
+    if (valid) {
+        catalogIndex.resize(h.tilesPerSide * h.tilesPerSide);
+        valid = fread(catalogIndex.data(), sizeof(CatalogTileEntry), catalogIndex.size(), f) == catalogIndex.size();
+    }
+    fclose(f);
+    if (!valid) {
+        cerr << "Invalid star catalog " << path << endl;
+        catalogIndex.clear();
+        return false;
+    }
+
+    catalogPath = path;
+    catalogTiles.assign(catalogIndex.size(), {{}, 0, -1});
+    catalogStopping = false;
+    catalogLoader = thread(catalogLoaderLoop);
+    return true;
+}
+
+void stopStarCatalog() {
+    if (!catalogLoader.joinable()) return;
+    {
+        lock_guard<mutex> lock(catalogMutex);
+        catalogStopping = true;
+    }
+    catalogCondition.notify_all();
+    catalogLoader.join();
+}
+
+void drawStarCatalog(const Camera& cam) {
+    const CatalogHeader& h = catalogHeader;
+    float x0 = cam.x - viewHalfWidth / cam.zoom, x1 = cam.x + viewHalfWidth / cam.zoom;
+    float y0 = cam.y - viewHalfHeight / cam.zoom, y1 = cam.y + viewHalfHeight / cam.zoom;
+    if (x1 <= -h.extent || x0 >= h.extent || y1 <= -h.extent || y0 >= h.extent) return;
+    int tx0 = catalogTileCoord(x0), tx1 = catalogTileCoord(x1);
+    int ty0 = catalogTileCoord(y0), ty1 = catalogTileCoord(y1);
+
+    long long totals[CATALOG_MAG_STEPS] = {0};
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            const CatalogTileEntry& e = catalogIndex[ty * h.tilesPerSide + tx];
+            for (int k = 0; k < CATALOG_MAG_STEPS; k++) totals[k] += e.cumulative[k];
+        }
+    }
+    int step = 0;
+    while (step < CATALOG_MAG_STEPS && totals[step] <= catalogStarBudget) step++;
+    float fraction = 0.0f;
+    catalogMagnitudeLimit = 1e9f;
+    if (step < CATALOG_MAG_STEPS) {
+        long long below = step > 0 ? totals[step - 1] : 0;
+        fraction = (catalogStarBudget - below) / (float)(totals[step] - below);
+        catalogMagnitudeLimit = (step + fraction) * CATALOG_MAG_STEP;
+    }
+
+    for (auto& b : catalogBatches) {
+        b.vertices.clear();
+        b.colors.clear();
+    }
+    bool requested = false;
+    {
+        lock_guard<mutex> lock(catalogMutex);
+        catalogFrame++;
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                int id = ty * h.tilesPerSide + tx;
+                const CatalogTileEntry& e = catalogIndex[id];
+                int lower = step > 0 ? e.cumulative[step - 1] : 0;
+                int upper = step < CATALOG_MAG_STEPS ? e.cumulative[step] : e.count;
+                int need = lower + (int)ceil(fraction * (upper - lower));
+
+                CatalogTile& t = catalogTiles[id];
+                t.lastUsed = catalogFrame;
+                if (t.requested < need && !catalogStopping) {
+                    t.requested = min(e.count, max(need + need / 2, 16));
+                    catalogRequests.push_back(id);
+                    requested = true;
+                }
+
+                for (const CatalogStar& s : t.stars) {
+                    if (s.magnitude >= catalogMagnitudeLimit) break;
+                    float base = min(max(1.0f - 0.06f * s.magnitude, 0.15f), 1.0f);
+                    float fade = min((catalogMagnitudeLimit - s.magnitude) / CATALOG_MAG_STEP, 1.0f);
+                    float twinkle = 0.5f + 0.5f * sin(sim.effectTime * s.twinkleSpeed + s.x * 10);
+                    float brightness = base * fade * twinkle;
+                    ParticleBatch& b = catalogBatches[base > 0.75f ? 2 : base > 0.5f ? 1 : 0];
+                    b.vertices.push_back(s.x);
+                    b.vertices.push_back(s.y);
+                    unsigned char level = colorByte(brightness);
+                    b.colors.insert(b.colors.end(), {level, level, colorByte(brightness * 1.1f), 255});
+                }
+            }
+        }
+    }
+    if (requested) catalogCondition.notify_one();
+
+    const float sizes[] = {1.3f, 2.0f, 2.8f};
+    catalogDrawn = 0;
+    glPushMatrix();
+    applyCamera(cam);
+    for (int i = 0; i < 3; i++) {
+        ParticleBatch& b = catalogBatches[i];
+        b.count = b.vertices.size() / 2;
+        b.pointSize = sizes[i];
+        b.streakLength = 0.0f;
+        b.additive = false;
+        drawParticles(b);
+        catalogDrawn += b.count;
+    }
+    glPopMatrix();
+}
+
+void drawStars() {
+    if (!catalogIndex.empty()) {
+        drawStarCatalog(cameras[currentFrame]);
+        return;
+    }
+    glEnable(GL_BLEND);
+    for (auto& s : stars) {
+        float twinkle = 0.5f + 0.5f * sin(sim.effectTime * s.twinkleSpeed + s.x * 10);
+        float brightness = s.brightness * twinkle;
+        glColor4f(brightness, brightness, brightness * 1.1f, 1.0f);
+        glPointSize(1.0f + brightness * 2.0f);
+        glBegin(GL_POINTS);
+        glVertex2f(s.x, s.y);
+        glEnd();
+    }
+}
+
+void drawOrbit(float radius, int segments) {
+    glEnable(GL_BLEND);
+    glBegin(GL_LINE_LOOP);
+    for (int i = 0; i < segments; i++) {
+        float theta = 2.0f * PI * i / segments;
+        glColor4f(0.3f, 0.3f, 0.4f, 0.3f);
+        glVertex2f(radius * cos(theta), radius * sin(theta));
+    }
+    glEnd();
+}
+
+void buildTrailRamps() {
+    const float classColors[TRAIL_CLASS_COUNT - 8][3] = {
+        {0.7f, 0.7f, 0.75f}, {0.85f, 0.75f, 0.65f}, {0.5f, 0.7f, 1.0f}, {0.5f, 0.5f, 0.5f}
+    };
+    int span = trailLength * 3;
+    trailRamps.assign(TRAIL_CLASS_COUNT * span * 4, 0);
+    for (int c = 0; c < TRAIL_CLASS_COUNT; c++) {
+        const float* rgb = c < 8 ? pColors[c] : classColors[c - 8];
+        for (int i = 0; i < trailLength; i++) {
+            float ramp = (i + 1.0f) / trailLength;
+            unsigned char* px = &trailRamps[(c * span + trailLength + i) * 4];
+            px[0] = colorByte(rgb[0]);
+            px[1] = colorByte(rgb[1]);
+            px[2] = colorByte(rgb[2]);
+            px[3] = colorByte(0.6f * ramp * ramp);
+        }
+    }
+}
+
+void resetTrails(int count) {
+    trailBodies = count;
+    trailPositions.assign((size_t)count * trailLength * 4, 0.0f);
+    trailHead = -1;
+    trailFilled = 0;
+    if (trailRamps.empty()) buildTrailRamps();
+    if (softwareRender) {
+        size_t lines = (size_t)count * (trailLength - 1);
+        swReserveLines(lines);
+        arenaReserve(frameArena.peakBytes + lines * 2 * sizeof(int));
+    }
+}
+
+// Samples a seek or a body-count change has invalidated are skipped by bumping the serial, so the
+// render thread sees a gap and restarts its trails instead of joining unrelated positions.
+void breakTrailSamples() {
+    trailSampleFloor = ++trailSampleSerial;
+}
+
+void recordTrails() {
+    const FrameState& fs = *frameView;
+    int count = fs.trailClasses.size();
+    if (count != trailBodies) resetTrails(count);
+    trailClasses = fs.trailClasses;
+    if (fs.controls.timeWarp > 1.0f) trailFilled = 0;
+
+    int ringFloats = trailLength * 4;
+    for (size_t s = 0; s < fs.trailSerials.size(); s++) {
+        long long serial = fs.trailSerials[s];
+        if (serial <= trailLastSerial) continue;
+        if (serial > trailLastSerial + 1) trailFilled = 0;
+        trailLastSerial = serial;
+        trailHead = (trailHead + 1) % trailLength;
+        trailFilled = min(trailFilled + 1, trailLength);
+        const float* points = &fs.trailPoints[s * count * 2];
+        for (int b = 0; b < count; b++) {
+            float* ring = &trailPositions[(size_t)b * ringFloats];
+            float x = points[b * 2], y = points[b * 2 + 1];
+            ring[trailHead * 2] = x;
+            ring[trailHead * 2 + 1] = y;
+            ring[(trailHead + trailLength) * 2] = x;
+            ring[(trailHead + trailLength) * 2 + 1] = y;
+        }
+    }
+    trailConsumedSerial.store(trailLastSerial, memory_order_release);
+}
+
+void drawTrails() {
+    if (!showTrails || trailFilled < 2) return;
+
+    int first = trailHead + trailLength - trailFilled + 1;
+    int span = trailLength * 3;
+    int rampOffset = trailLength - trailHead - 1;
+    glEnable(GL_BLEND);
+    glLineWidth(1.0f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    for (int b = 0; b < trailBodies; b++) {
+        unsigned char cls = trailClasses[b];
+        if (cls == TRAIL_HIDDEN) continue;
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, &trailRamps[(cls * span + rampOffset) * 4]);
+        glVertexPointer(2, GL_FLOAT, 0, &trailPositions[(size_t)b * trailLength * 4]);
+        glDrawArrays(GL_LINE_STRIP, first, trailFilled);
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+template <class F>
+void parallelFor(int count, const F& fn) {
+    int workers = max(1, (int)thread::hardware_concurrency());
+    workers = min(workers, max(1, count / 2048));
+    if (workers == 1) {
+        fn(0, count);
+        return;
+    }
+    int chunk = (count + workers - 1) / workers;
+    runParallel(workers, [&](int w) {
+        int begin = w * chunk;
+        int end = min(count, begin + chunk);
+        if (begin < end) fn(begin, end);
+    });
+}
+
+
+void planetPositionsAt(double angle, float* xy) {
+    for (int i = 0; i < 8; i++) {
+        float rad = wrapDegrees(angle * speeds[i]) * PI / 180.0f;
+        xy[i * 2] = distances[i] * cos(rad);
+        xy[i * 2 + 1] = distances[i] * sin(rad);
+    }
+}
+
+
+vector<unsigned int> mortonKeys;
+vector<unsigned int> mortonScratchKeys;
+vector<int> mortonOrder;
+vector<int> mortonScratchOrder;
+vector<NBodyParticle> nbodyScratch;
+
+unsigned int spreadBits(unsigned int v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+void sortParticlesByMorton(float minX, float minY, float size) {
+    int n = nbodyParticles.size();
+    mortonKeys.resize(n);
+    mortonScratchKeys.resize(n);
+    mortonOrder.resize(n);
+    mortonScratchOrder.resize(n);
+    nbodyScratch.resize(n);
+
+    float scale = 65535.0f / size;
+    parallelFor(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            unsigned int qx = (unsigned int)((nbodyParticles[i].x - minX) * scale);
+            unsigned int qy = (unsigned int)((nbodyParticles[i].y - minY) * scale);
+            mortonKeys[i] = spreadBits(qx) | (spreadBits(qy) << 1);
+            mortonOrder[i] = i;
+        }
+    });
+
+    for (int pass = 0; pass < 4; pass++) {
+        int shift = pass * 8;
+        int counts[257] = {0};
+        for (int i = 0; i < n; i++) counts[((mortonKeys[i] >> shift) & 0xFF) + 1]++;
+        for (int b = 0; b < 256; b++) counts[b + 1] += counts[b];
+        for (int i = 0; i < n; i++) {
+            int dst = counts[(mortonKeys[i] >> shift) & 0xFF]++;
+            mortonScratchKeys[dst] = mortonKeys[i];
+            mortonScratchOrder[dst] = mortonOrder[i];
+        }
+        mortonKeys.swap(mortonScratchKeys);
+        mortonOrder.swap(mortonScratchOrder);
+    }
+
+    for (int i = 0; i < n; i++) {
+        nbodyScratch[i] = nbodyParticles[mortonOrder[i]];
+        if (nbodyScratch[i].id == 0) nbodyCometSlot = i;
+    }
+    nbodyParticles.swap(nbodyScratch);
+}
+
+const int QUAD_LEAF_SIZE = 32;
+const int QUAD_MAX_DEPTH = 15;
+
+// Every depth splits at most n / (QUAD_LEAF_SIZE + 1) nodes into four, which bounds the tree, so
+// the force pass can size its buffers once instead of growing them in steady-state frames.
+int quadTreeCapacity(int n) {
+    return 1 + 4 * QUAD_MAX_DEPTH * (n / (QUAD_LEAF_SIZE + 1) + 1);
+}
+
+int buildQuadNode(int first, int count, int depth, float cx, float cy, float half) {
+    int index = quadNodes.size();
+    QuadNode node;
+    node.cx = cx;
+    node.cy = cy;
+    node.half = half;
+    node.first = first;
+    node.count = count;
+    node.leaf = count <= QUAD_LEAF_SIZE || depth >= QUAD_MAX_DEPTH;
+    node.mass = 0;
+    node.comX = 0;
+    node.comY = 0;
+    for (int c = 0; c < 4; c++) node.child[c] = -1;
+    quadNodes.push_back(node);
+
+    if (node.leaf) {
+        float m = 0, mx = 0, my = 0;
+        for (int i = first; i < first + count; i++) {
+            const NBodyParticle& p = nbodyParticles[i];
+            m += p.mass;
+            mx += p.x * p.mass;
+            my += p.y * p.mass;
+        }
+        quadNodes[index].mass = m;
+        quadNodes[index].comX = m > 0 ? mx / m : cx;
+        quadNodes[index].comY = m > 0 ? my / m : cy;
+        return index;
+    }
+
+    int shift = 30 - depth * 2;
+    int begin = first;
+    int last = first + count;
+    float m = 0, mx = 0, my = 0;
+    for (int q = 0; q < 4; q++) {
+        int end = lower_bound(mortonKeys.begin() + begin, mortonKeys.begin() + last, (unsigned int)(q + 1),
+                              [shift](unsigned int key, unsigned int quad) { return ((key >> shift) & 3) < quad; })
+                  - mortonKeys.begin();
+        if (end > begin) {
+            float h = half * 0.5f;
+            float qx = cx + ((q & 1) ? h : -h);
+            float qy = cy + ((q & 2) ? h : -h);
+            int child = buildQuadNode(begin, end - begin, depth + 1, qx, qy, h);
+            quadNodes[index].child[q] = child;
+            m += quadNodes[child].mass;
+            mx += quadNodes[child].comX * quadNodes[child].mass;
+            my += quadNodes[child].comY * quadNodes[child].mass;
+        }
+        begin = end;
+    }
+    quadNodes[index].mass = m;
+    quadNodes[index].comX = m > 0 ? mx / m : cx;
+    quadNodes[index].comY = m > 0 ? my / m : cy;
+    return index;
+}
+
+void buildQuadTree() {
+    int n = nbodyParticles.size();
+    float minX = 1e9f, minY = 1e9f, maxX = -1e9f, maxY = -1e9f;
+    for (auto& p : nbodyParticles) {
+        minX = min(minX, p.x);
+        minY = min(minY, p.y);
+        maxX = max(maxX, p.x);
+        maxY = max(maxY, p.y);
+    }
+    float size = max(maxX - minX, maxY - minY) * 1.001f + 1e-6f;
+
+    sortParticlesByMorton(minX, minY, size);
+
+    quadNodes.clear();
+    quadNodes.reserve(quadTreeCapacity(n));
+    buildQuadNode(0, n, 0, minX + size * 0.5f, minY + size * 0.5f, size * 0.5f);
+}
+
+vector<int> quadLeaves;
+
+void computeNBodyForces(double angle) {
+    float planetXY[16];
+    planetPositionsAt(angle, planetXY);
+
+    buildQuadTree();
+    int capacity = quadTreeCapacity(nbodyParticles.size());
+    quadLeaves.reserve(capacity);
+    quadLeaves.clear();
+    for (int i = 0; i < (int)quadNodes.size(); i++) {
+        if (quadNodes[i].leaf) quadLeaves.push_back(i);
+    }
+
+    float theta2 = nbodyTheta * nbodyTheta;
+    float eps2 = nbodySoftening * nbodySoftening;
+
+    parallelFor(quadLeaves.size(), [&](int begin, int end) {
+        static thread_local vector<float> sourceX, sourceY, sourceM;
+        size_t sourceCapacity = 9 + nbodyParticles.size() + capacity;
+        sourceX.reserve(sourceCapacity);
+        sourceY.reserve(sourceCapacity);
+        sourceM.reserve(sourceCapacity);
+        int stack[128];
+        for (int l = begin; l < end; l++) {
+            const QuadNode& leaf = quadNodes[quadLeaves[l]];
+            float minX = 1e9f, minY = 1e9f, maxX = -1e9f, maxY = -1e9f;
+            for (int i = leaf.first; i < leaf.first + leaf.count; i++) {
+                minX = min(minX, nbodyParticles[i].x);
+                minY = min(minY, nbodyParticles[i].y);
+                maxX = max(maxX, nbodyParticles[i].x);
+                maxY = max(maxY, nbodyParticles[i].y);
+            }
+
+            sourceX.clear();
+            sourceY.clear();
+            sourceM.clear();
+            for (int k = 0; k < 8; k++) {
+                sourceX.push_back(planetXY[k * 2]);
+                sourceY.push_back(planetXY[k * 2 + 1]);
+                sourceM.push_back(planetMasses[k] * nbodyPlanetMassScale);
+            }
+            sourceX.push_back(0.0f);
+            sourceY.push_back(0.0f);
+            sourceM.push_back(1.0f);
+
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const QuadNode& node = quadNodes[stack[--top]];
+                float dx = max(max(minX - node.comX, node.comX - maxX), 0.0f);
+                float dy = max(max(minY - node.comY, node.comY - maxY), 0.0f);
+                float width = node.half * 2.0f;
+                if (width * width < theta2 * (dx * dx + dy * dy)) {
+                    sourceX.push_back(node.comX);
+                    sourceY.push_back(node.comY);
+                    sourceM.push_back(node.mass);
+                } else if (node.leaf) {
+                    for (int j = node.first; j < node.first + node.count; j++) {
+                        sourceX.push_back(nbodyParticles[j].x);
+                        sourceY.push_back(nbodyParticles[j].y);
+                        sourceM.push_back(nbodyParticles[j].mass);
+                    }
+                } else {
+                    for (int c = 0; c < 4; c++) {
+                        if (node.child[c] >= 0 && top < 128) stack[top++] = node.child[c];
+                    }
+                }
+            }
+
+            int sources = sourceX.size();
+            const float* sx = sourceX.data();
+            const float* sy = sourceY.data();
+            const float* sm = sourceM.data();
+            for (int i = leaf.first; i < leaf.first + leaf.count; i++) {
+                NBodyParticle& p = nbodyParticles[i];
+                float ax = 0, ay = 0;
+                int k = 0;
+#if defined(__SSE2__)
+                __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), soft = _mm_set1_ps(eps2);
+                __m128 half = _mm_set1_ps(0.5f), three = _mm_set1_ps(3.0f);
+                __m128 accX = _mm_setzero_ps(), accY = _mm_setzero_ps();
+                for (; k + 4 <= sources; k += 4) {
+                    __m128 dx = _mm_sub_ps(_mm_loadu_ps(sx + k), px);
+                    __m128 dy = _mm_sub_ps(_mm_loadu_ps(sy + k), py);
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), soft);
+                    __m128 r = _mm_rsqrt_ps(d2);
+                    r = _mm_mul_ps(_mm_mul_ps(half, r), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(d2, r), r)));
+                    __m128 m = _mm_mul_ps(_mm_loadu_ps(sm + k), _mm_mul_ps(r, _mm_mul_ps(r, r)));
+                    accX = _mm_add_ps(accX, _mm_mul_ps(dx, m));
+                    accY = _mm_add_ps(accY, _mm_mul_ps(dy, m));
+                }
+                float lanes[4];
+                _mm_storeu_ps(lanes, accX);
+                ax = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm_storeu_ps(lanes, accY);
+                ay = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+                for (; k < sources; k++) {
+                    float dx = sx[k] - p.x;
+                    float dy = sy[k] - p.y;
+                    float d2 = dx * dx + dy * dy + eps2;
+                    float m = sm[k] / (d2 * sqrt(d2));
+                    ax += dx * m;
+                    ay += dy * m;
+                }
+                p.ax = ax * NBODY_GM_SUN;
+                p.ay = ay * NBODY_GM_SUN;
+            }
+        }
+    });
+}
+
+void seedNBodyBelt() {
+    nbodyParticles.clear();
+    nbodyParticles.reserve(nbodyParticleCount);
+    float particleMass = nbodyBeltMass / max(1, nbodyParticleCount);
+
+    NBodyParticle comet;
+    comet.x = 1.3f;
+    comet.y = 0.0f;
+    comet.vx = 0.0f;
+    comet.vy = 0.35f * sqrt(NBODY_GM_SUN / 1.3f);
+    comet.mass = 0.0f;
+    comet.id = 0;
+    nbodyParticles.push_back(comet);
+    nbodyCometSlot = 0;
+
+    for (auto& a : asteroids) {
+        if ((int)nbodyParticles.size() >= nbodyParticleCount) break;
+        float rad = a.angle + wrapRadians(liveSim.angleAll * a.speed);
+        float v = sqrt(NBODY_GM_SUN / a.distance);
+        NBodyParticle p;
+        p.x = a.distance * cos(rad);
+        p.y = a.distance * sin(rad);
+        p.vx = -v * sin(rad);
+        p.vy = v * cos(rad);
+        p.mass = particleMass;
+        p.id = nbodyParticles.size();
+        nbodyParticles.push_back(p);
+    }
+
+    while ((int)nbodyParticles.size() < nbodyParticleCount) {
+        float rad = (simRandom() % 36000) * PI / 18000.0f;
+        float dist = 0.56f + (simRandom() % 1000) / 10000.0f;
+        float v = sqrt(NBODY_GM_SUN / dist) * (0.98f + (simRandom() % 400) / 10000.0f);
+        NBodyParticle p;
+        p.x = dist * cos(rad);
+        p.y = dist * sin(rad);
+        p.vx = -v * sin(rad);
+        p.vy = v * cos(rad);
+        p.mass = particleMass;
+        p.id = nbodyParticles.size();
+        nbodyParticles.push_back(p);
+    }
+}
+
+void initializeNBody() {
+    seedNBodyBelt();
+    nbodyStepCount = 0;
+    computeNBodyForces(liveSim.angleAll);
+}
+
+void stepNBody(double startAngle, double endAngle, float dt) {
+    if (liveControls.nbodyLeapfrog) {
+        parallelFor(nbodyParticles.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                NBodyParticle& p = nbodyParticles[i];
+                p.vx += p.ax * dt * 0.5f;
+                p.vy += p.ay * dt * 0.5f;
+                p.x += p.vx * dt;
+                p.y += p.vy * dt;
+            }
+        });
+        computeNBodyForces(endAngle);
+        parallelFor(nbodyParticles.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                NBodyParticle& p = nbodyParticles[i];
+                p.vx += p.ax * dt * 0.5f;
+                p.vy += p.ay * dt * 0.5f;
+            }
+        });
+    } else {
+        computeNBodyForces(startAngle);
+        parallelFor(nbodyParticles.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                NBodyParticle& p = nbodyParticles[i];
+                p.vx += p.ax * dt;
+                p.vy += p.ay * dt;
+                p.x += p.vx * dt;
+                p.y += p.vy * dt;
+            }
+        });
+    }
+    nbodyStepCount++;
+}
+
+void drawAsteroidBelt() {
+    if (nbodyMode) {
+        const vector<float>& points = frameView->nbodyPoints;
+        int stride = qualityTiers[qualityTier].particleStride;
+        glColor4f(0.55f, 0.55f, 0.6f, 0.35f);
+        glPointSize(1.0f);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(2, GL_FLOAT, stride * 2 * sizeof(float), points.data());
+        glDrawArrays(GL_POINTS, 0, (points.size() / 2 + stride - 1) / stride);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
+        const vector<float>& rocks = frameView->nbodyAsteroids;
+        glColor4f(0.5f, 0.5f, 0.5f, 0.7f);
+        for (size_t i = 0; i < rocks.size(); i += 3) {
+            drawCircle(rocks[i], rocks[i + 1], rocks[i + 2], 8);
+        }
+    } else {
+        glColor4f(0.5f, 0.5f, 0.5f, 0.7f);
+        for (auto& a : asteroids) {
+            float rad = a.angle + wrapRadians(sim.angleAll * a.speed);
+            float x = a.distance * cos(rad);
+            float y = a.distance * sin(rad);
+            drawCircle(x, y, a.size, 8);
+        }
+    }
+
+  
+    float cx = frameTransforms.worldX[ceresNode];
+    float cy = frameTransforms.worldY[ceresNode];
+    glColor4f(0.7f, 0.7f, 0.6f, 1.0f);
+    drawCircle(cx, cy, ceresSize, 12);
+    drawGlow(cx, cy, ceresSize, 0.6f, 0.6f, 0.5f, 0.15f);
+}
+
+
+void drawDayNightMask(float cx, float cy, float r, float angleDeg) {
+    glPushMatrix();
+    glTranslatef(cx, cy, 0);
+    glRotatef(angleDeg, 0, 0, 1);
+    glEnable(GL_BLEND);
+    glColor4f(0, 0, 0, 0.5f);
+
+    glBegin(GL_TRIANGLE_FAN);
+    glVertex2f(0, 0);
     for (int i = 90; i <= 270; i++) {
         float rad = i * PI / 180.0f;
         glVertex2f(r * cos(rad), r * sin(rad));
@@ -406,7 +2697,7 @@ void drawJupiterSpot(float cx, float cy, float r, float rotation) {
     for (float by = -0.6f; by <= 0.6f; by += 0.3f) {
         glBegin(GL_LINES);
         glVertex2f(-r, by * r);
-        glVertex2f(r, by * r + sin(angleAll * 0.1f + by) * 0.05f);
+        glVertex2f(r, by * r + sin(sim.effectTime * 0.1f + by) * 0.05f);
         glEnd();
     }
 
@@ -452,28 +2743,862 @@ void drawPlanetShadow(float cx, float cy, float r, float sunAngle) {
 }
 
 
-void drawEclipseShadow(float moonX, float moonY, float moonR, float earthX, float earthY) {
+void planetPositionAt(int i, double angle, double& x, double& y) {
+    double rad = angle * speeds[i] * PI / 180.0;
+    x = distances[i] * cos(rad);
+    y = distances[i] * sin(rad);
+}
+
+void moonPositionAt(int i, int m, double angle, double& x, double& y) {
+    planetPositionAt(i, angle, x, y);
+    double orbit = planetSizes[i] * (2.0 + m * 0.8);
+    double rad = (angle * (2.0 - m * 0.3) + m * 60) * PI / 180.0;
+    x += orbit * cos(rad);
+    y += orbit * sin(rad);
+}
+
+double moonRadiusOf(int i, int m) {
+    return planetSizes[i] * (0.15 + m * 0.05);
+}
+
+bool shadowCone(double ox, double oy, double ro, double px, double py, double sunR,
+                double& h, double& umbra, double& penumbra) {
+    double dist = sqrt(ox * ox + oy * oy);
+    if (dist < 1e-6) return false;
+    double ux = ox / dist, uy = oy / dist;
+    double d = (px - ox) * ux + (py - oy) * uy;
+    if (d <= 0.0) return false;
+    h = fabs((px - ox) * uy - (py - oy) * ux);
+    umbra = ro - d * (sunR - ro) / dist;
+    penumbra = ro + d * (sunR + ro) / dist;
+    return true;
+}
+
+float shadowDarkness(double ox, double oy, double ro, double px, double py, double sunR) {
+    double h, umbra, penumbra;
+    if (!shadowCone(ox, oy, ro, px, py, sunR, h, umbra, penumbra) || h >= penumbra) return 0.0f;
+    double peak = umbra >= 0.0 ? 1.0 : (ro / (ro - umbra)) * (ro / (ro - umbra));
+    double core = max(umbra, 0.0);
+    if (h <= core) return peak;
+    return peak * (penumbra - h) / (penumbra - core);
+}
+
+double eclipseMargin(int kind, int planet, int moon, double angle, double* umbraMargin = nullptr,
+                     double* totalMargin = nullptr) {
+    double ox, oy, ro, tx, ty, tr;
+    if (kind == EVENT_SUN_TRANSIT) {
+        double ex, ey;
+        planetPositionAt(2, angle, ex, ey);
+        planetPositionAt(planet, angle, tx, ty);
+        double sunDist = sqrt(ex * ex + ey * ey);
+        double jx = tx - ex, jy = ty - ey;
+        double planetDist = sqrt(jx * jx + jy * jy);
+        if (planetDist >= sunDist) return 1.0;
+        double separation = acos(max(-1.0, min(1.0, -(ex * jx + ey * jy) / (sunDist * planetDist))));
+        double sunSize = asin(ECLIPSE_SUN_RADIUS / sunDist), planetSize = asin(planetSizes[planet] / planetDist);
+        if (umbraMargin) *umbraMargin = separation - (sunSize - planetSize);
+        if (totalMargin) *totalMargin = separation - (sunSize - planetSize);
+        return separation - (sunSize + planetSize);
+    }
+
+    if (kind == EVENT_MOON_ECLIPSE) {
+        planetPositionAt(planet, angle, ox, oy);
+        ro = planetSizes[planet];
+        moonPositionAt(planet, moon, angle, tx, ty);
+        tr = moonRadiusOf(planet, moon);
+    } else {
+        moonPositionAt(planet, moon, angle, ox, oy);
+        ro = moonRadiusOf(planet, moon);
+        planetPositionAt(planet, angle, tx, ty);
+        tr = planetSizes[planet];
+    }
+    double h, umbra, penumbra;
+    if (!shadowCone(ox, oy, ro, tx, ty, ECLIPSE_SUN_RADIUS, h, umbra, penumbra)) {
+        return sqrt((tx - ox) * (tx - ox) + (ty - oy) * (ty - oy)) - (ro + tr);
+    }
+    if (umbraMargin) *umbraMargin = umbra > 0.0 ? h - (umbra + tr) : 1.0;
+    if (totalMargin) *totalMargin = umbra > 0.0 ? h - (umbra - tr) : 1.0;
+    return h - (penumbra + tr);
+}
+
+double refineEclipseContact(int kind, int planet, int moon, double lo, double hi) {
+    double flo = eclipseMargin(kind, planet, moon, lo), fhi = eclipseMargin(kind, planet, moon, hi);
+    int side = 0;
+    for (int i = 0; i < 40 && hi - lo > 1e-7; i++) {
+        double mid = (lo * fhi - hi * flo) / (fhi - flo);
+        if (!(mid > lo && mid < hi)) mid = 0.5 * (lo + hi);
+        double f = eclipseMargin(kind, planet, moon, mid);
+        if ((f < 0.0) == (flo < 0.0)) {
+            lo = mid;
+            flo = f;
+            if (side == -1) fhi *= 0.5;
+            side = -1;
+        } else {
+            hi = mid;
+            fhi = f;
+            if (side == 1) flo *= 0.5;
+            side = 1;
+        }
+        if (f == 0.0) return mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+void searchEclipseKind(int kind, int planet, int moon, double from, double to, double step, double maxRate,
+                       vector<EclipseEvent>& out) {
+    // Events under way at either edge of the window are followed past it to their real contacts, so
+    // every event that overlaps [from, to] is reported whole rather than clipped or dropped.
+    double t = from;
+    double margin = eclipseMargin(kind, planet, moon, t);
+    double start = from;
+    bool open = margin < 0.0;
+    if (open) {
+        double inside = from, before = from - step;
+        while (eclipseMargin(kind, planet, moon, before) < 0.0) {
+            inside = before;
+            before -= step;
+        }
+        start = refineEclipseContact(kind, planet, moon, before, inside);
+    }
+    while (t < to || open) {
+        double next = t + (maxRate > 0.0 ? max(fabs(margin) / maxRate, step) : step);
+        if (!open) next = min(next, to);
+        margin = eclipseMargin(kind, planet, moon, next);
+        bool inside = margin < 0.0;
+        if (inside && !open) {
+            start = refineEclipseContact(kind, planet, moon, t, next);
+            open = true;
+        } else if (!inside && open) {
+            EclipseEvent e = {kind, planet, moon, DEPTH_PENUMBRAL, start, start, refineEclipseContact(kind, planet, moon, t, next)};
+
+            const double golden = 0.381966;
+            double a = e.start, b = e.end;
+            double m1 = a + (b - a) * golden, m2 = b - (b - a) * golden;
+            double f1 = eclipseMargin(kind, planet, moon, m1), f2 = eclipseMargin(kind, planet, moon, m2);
+            for (int i = 0; i < 12; i++) {
+                if (f1 < f2) {
+                    b = m2; m2 = m1; f2 = f1;
+                    m1 = a + (b - a) * golden;
+                    f1 = eclipseMargin(kind, planet, moon, m1);
+                } else {
+                    a = m1; m1 = m2; f1 = f2;
+                    m2 = b - (b - a) * golden;
+                    f2 = eclipseMargin(kind, planet, moon, m2);
+                }
+            }
+            e.peak = 0.5 * (a + b);
+            double umbraMargin = 1.0, totalMargin = 1.0;
+            eclipseMargin(kind, planet, moon, e.peak, &umbraMargin, &totalMargin);
+            if (totalMargin <= 0.0) e.depth = DEPTH_TOTAL;
+            else if (umbraMargin < 0.0) e.depth = DEPTH_PARTIAL;
+            out.push_back(e);
+            open = false;
+        }
+        t = next;
+    }
+}
+
+void searchEclipses(double from, double to, vector<EclipseEvent>& out) {
+    out.clear();
+    for (int i = 0; i < 8; i++) {
+        for (int m = 0; m < moonCounts[i]; m++) {
+            double orbit = planetSizes[i] * (2.0 + m * 0.8);
+            double nearest = distances[i] - orbit;
+            double moonRate = (2.0 - m * 0.3) * PI / 180.0;
+            double axisRate = (distances[i] * speeds[i] * PI / 180.0 + orbit * moonRate) / nearest;
+            double maxRate = 1.25 * orbit * (moonRate + axisRate) * (1.0 + (ECLIPSE_SUN_RADIUS + planetSizes[i]) / nearest);
+            double reach = min(1.0, (planetSizes[i] * 2.0 + moonRadiusOf(i, m)) / orbit);
+            double step = 0.25 * asin(reach) / max(fabs(moonRate - speeds[i] * PI / 180.0), 1e-4);
+            searchEclipseKind(EVENT_MOON_ECLIPSE, i, m, from, to, step, maxRate, out);
+            searchEclipseKind(EVENT_SHADOW_TRANSIT, i, m, from, to, step, maxRate, out);
+        }
+    }
+    for (int j = 0; j < 2; j++) searchEclipseKind(EVENT_SUN_TRANSIT, j, 0, from, to, 2.0, 0.0, out);
+    sort(out.begin(), out.end(), [](const EclipseEvent& a, const EclipseEvent& b) { return a.start < b.start; });
+}
+
+void updateEclipseSearch() {
+    double now = liveSim.angleAll;
+    if (now < eclipseSearchedFrom || now > eclipseSearchedTo - eclipseHorizon * 0.5) {
+        eclipseSearchedFrom = now - 200.0;
+        eclipseSearchedTo = now + eclipseHorizon;
+        searchEclipses(eclipseSearchedFrom, eclipseSearchedTo, eclipseEvents);
+    }
+    while (!eclipseEvents.empty() && eclipseEvents.front().end < now) {
+        eclipseEvents.erase(eclipseEvents.begin());
+    }
+}
+
+void drawEclipseShadow(float tx, float ty, float tr, float ox, float oy, float ro, float sunR) {
     if (!eclipseMode) return;
+    double h, umbra, penumbra;
+    if (!shadowCone(ox, oy, ro, tx, ty, sunR, h, umbra, penumbra) || h >= penumbra + tr) return;
+
+    const int rings = 3, seg = 32;
+    glEnable(GL_BLEND);
+    for (int ring = 0; ring < rings; ring++) {
+        float r0 = tr * ring / rings, r1 = tr * (ring + 1) / rings;
+        glBegin(GL_QUAD_STRIP);
+        for (int i = 0; i <= seg; i++) {
+            float theta = 2.0f * PI * i / seg;
+            float c = cos(theta), sn = sin(theta);
+            glColor4f(0, 0, 0, 0.85f * shadowDarkness(ox, oy, ro, tx + r0 * c, ty + r0 * sn, sunR));
+            glVertex2f(tx + r0 * c, ty + r0 * sn);
+            glColor4f(0, 0, 0, 0.85f * shadowDarkness(ox, oy, ro, tx + r1 * c, ty + r1 * sn, sunR));
+            glVertex2f(tx + r1 * c, ty + r1 * sn);
+        }
+        glEnd();
+    }
+}
+
+PFNGLGENBUFFERSPROC pglGenBuffers = nullptr;
+PFNGLDELETEBUFFERSPROC pglDeleteBuffers = nullptr;
+PFNGLBINDBUFFERPROC pglBindBuffer = nullptr;
+PFNGLBUFFERDATAPROC pglBufferData = nullptr;
+PFNGLMAPBUFFERPROC pglMapBuffer = nullptr;
+PFNGLUNMAPBUFFERPROC pglUnmapBuffer = nullptr;
+PFNGLCREATESHADERPROC pglCreateShader = nullptr;
+PFNGLDELETESHADERPROC pglDeleteShader = nullptr;
+PFNGLSHADERSOURCEPROC pglShaderSource = nullptr;
+PFNGLCOMPILESHADERPROC pglCompileShader = nullptr;
+PFNGLGETSHADERIVPROC pglGetShaderiv = nullptr;
+PFNGLGETSHADERINFOLOGPROC pglGetShaderInfoLog = nullptr;
+PFNGLCREATEPROGRAMPROC pglCreateProgram = nullptr;
+PFNGLDELETEPROGRAMPROC pglDeleteProgram = nullptr;
+PFNGLATTACHSHADERPROC pglAttachShader = nullptr;
+PFNGLLINKPROGRAMPROC pglLinkProgram = nullptr;
+PFNGLGETPROGRAMIVPROC pglGetProgramiv = nullptr;
+PFNGLUSEPROGRAMPROC pglUseProgram = nullptr;
+PFNGLGETUNIFORMLOCATIONPROC pglGetUniformLocation = nullptr;
+PFNGLUNIFORM1FPROC pglUniform1f = nullptr;
+PFNGLUNIFORM2FPROC pglUniform2f = nullptr;
+PFNGLUNIFORM4FPROC pglUniform4f = nullptr;
+typedef int (*SwapIntervalProc)(int);
+SwapIntervalProc pSwapInterval = nullptr;
+
+void loadGLExtensions() {
+    const char* swapNames[] = {"glXSwapIntervalMESA", "wglSwapIntervalEXT", "glXSwapIntervalSGI"};
+    for (const char* name : swapNames) {
+        if (!pSwapInterval) pSwapInterval = (SwapIntervalProc)glutGetProcAddress(name);
+    }
+    pglGenBuffers = (PFNGLGENBUFFERSPROC)glutGetProcAddress("glGenBuffers");
+    pglDeleteBuffers = (PFNGLDELETEBUFFERSPROC)glutGetProcAddress("glDeleteBuffers");
+    pglBindBuffer = (PFNGLBINDBUFFERPROC)glutGetProcAddress("glBindBuffer");
+    pglBufferData = (PFNGLBUFFERDATAPROC)glutGetProcAddress("glBufferData");
+    pglMapBuffer = (PFNGLMAPBUFFERPROC)glutGetProcAddress("glMapBuffer");
+    pglUnmapBuffer = (PFNGLUNMAPBUFFERPROC)glutGetProcAddress("glUnmapBuffer");
+    pglCreateShader = (PFNGLCREATESHADERPROC)glutGetProcAddress("glCreateShader");
+    pglDeleteShader = (PFNGLDELETESHADERPROC)glutGetProcAddress("glDeleteShader");
+    pglShaderSource = (PFNGLSHADERSOURCEPROC)glutGetProcAddress("glShaderSource");
+    pglCompileShader = (PFNGLCOMPILESHADERPROC)glutGetProcAddress("glCompileShader");
+    pglGetShaderiv = (PFNGLGETSHADERIVPROC)glutGetProcAddress("glGetShaderiv");
+    pglGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)glutGetProcAddress("glGetShaderInfoLog");
+    pglCreateProgram = (PFNGLCREATEPROGRAMPROC)glutGetProcAddress("glCreateProgram");
+    pglDeleteProgram = (PFNGLDELETEPROGRAMPROC)glutGetProcAddress("glDeleteProgram");
+    pglAttachShader = (PFNGLATTACHSHADERPROC)glutGetProcAddress("glAttachShader");
+    pglLinkProgram = (PFNGLLINKPROGRAMPROC)glutGetProcAddress("glLinkProgram");
+    pglGetProgramiv = (PFNGLGETPROGRAMIVPROC)glutGetProcAddress("glGetProgramiv");
+    pglUseProgram = (PFNGLUSEPROGRAMPROC)glutGetProcAddress("glUseProgram");
+    pglGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)glutGetProcAddress("glGetUniformLocation");
+    pglUniform1f = (PFNGLUNIFORM1FPROC)glutGetProcAddress("glUniform1f");
+    pglUniform2f = (PFNGLUNIFORM2FPROC)glutGetProcAddress("glUniform2f");
+    pglUniform4f = (PFNGLUNIFORM4FPROC)glutGetProcAddress("glUniform4f");
+}
+
+bool hasPixelBuffers() {
+    return pglGenBuffers && pglDeleteBuffers && pglBindBuffer && pglBufferData && pglMapBuffer && pglUnmapBuffer;
+}
+
+bool hasShaders() {
+    return pglCreateShader && pglDeleteShader && pglShaderSource && pglCompileShader && pglGetShaderiv &&
+           pglGetShaderInfoLog && pglCreateProgram && pglDeleteProgram && pglAttachShader && pglLinkProgram &&
+           pglGetProgramiv && pglUseProgram && pglGetUniformLocation && pglUniform1f && pglUniform2f && pglUniform4f;
+}
+
+bool useShaders = true;
+
+GLuint compileShader(GLenum type, const char* source, const char* label) {
+    GLuint shader = pglCreateShader(type);
+    pglShaderSource(shader, 1, &source, nullptr);
+    pglCompileShader(shader);
+    GLint ok = 0;
+    pglGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[512] = {0};
+        pglGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        cerr << label << " shader failed to compile: " << log << endl;
+        pglDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint buildProgram(const char* vertexSource, const char* fragmentSource, const char* label) {
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource, label);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource, label);
+    GLuint program = 0;
+    if (vs && fs) {
+        program = pglCreateProgram();
+        pglAttachShader(program, vs);
+        pglAttachShader(program, fs);
+        pglLinkProgram(program);
+        GLint ok = 0;
+        pglGetProgramiv(program, GL_LINK_STATUS, &ok);
+        if (!ok) {
+            cerr << label << " shader failed to link, using immediate mode" << endl;
+            pglDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (vs) pglDeleteShader(vs);
+    if (fs) pglDeleteShader(fs);
+    return program;
+}
+
+struct PlanetLighting {
+    float nightShade;
+    float atmosphere[4];
+    float nightGlow[4];
+};
+
+const PlanetLighting planetLighting[8] = {
+    {0.45f, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {0.45f, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {0.5f, {0.3f, 0.6f, 1.0f, 0.6f}, {1.0f, 0.75f, 0.4f, 0.05f}},
+    {0.45f, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {0.45f, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {0.45f, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {0.45f, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {0.45f, {0, 0, 0, 0}, {0, 0, 0, 0}}
+};
+
+const float LIT_DISC_EXTENT = 2.5f;
+const float LIT_DISC_RIM = 1.3f;
+
+// One quad per planet, blended as premultiplied alpha: the glow and atmosphere add light outside
+// the disc while the night side darkens the surface below through alpha, with a soft terminator.
+const char* planetVertexShader =
+    "#version 110\n"
+    "varying vec2 disc;\n"
+    "void main() {\n"
+    "    disc = gl_MultiTexCoord0.xy;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+    "}\n";
+
+const char* planetFragmentShader =
+    "#version 110\n"
+    "uniform vec2 sunDirection;\n"
+    "uniform vec4 glow;\n"
+    "uniform vec4 atmosphere;\n"
+    "uniform vec4 nightGlow;\n"
+    "uniform float nightShade;\n"
+    "varying vec2 disc;\n"
+    "void main() {\n"
+    "    float d = length(disc);\n"
+    "    float facing = dot(disc, sunDirection) / max(d, 0.0001);\n"
+    "    float night = 1.0 - smoothstep(-0.08, 0.08, dot(disc, sunDirection));\n"
+    "    vec3 inside = nightGlow.rgb * nightGlow.a * night;\n"
+    "    inside += atmosphere.rgb * atmosphere.a * 0.5 * smoothstep(0.8, 1.0, d) * (1.0 - night);\n"
+    "    float halo = max(1.0 - (d - 1.0) / 1.5, 0.0);\n"
+    "    float rim = max(1.0 - (d - 1.0) / 0.3, 0.0);\n"
+    "    vec3 outside = glow.rgb * glow.a * 7.5 * halo * halo;\n"
+    "    outside += atmosphere.rgb * atmosphere.a * rim * rim * (0.7 + 0.3 * facing);\n"
+    "    float edge = smoothstep(0.98, 1.02, d);\n"
+    "    gl_FragColor = vec4(mix(inside, outside, edge), nightShade * night * (1.0 - edge));\n"
+    "}\n";
+
+GLuint planetProgram = 0;
+GLint planetSunUniform = -1, planetGlowUniform = -1, planetAtmosphereUniform = -1;
+GLint planetNightGlowUniform = -1, planetShadeUniform = -1;
+
+void initPlanetShader() {
+    if (!useShaders || !hasShaders()) return;
+    planetProgram = buildProgram(planetVertexShader, planetFragmentShader, "Planet lighting");
+    if (!planetProgram) return;
+    planetSunUniform = pglGetUniformLocation(planetProgram, "sunDirection");
+    planetGlowUniform = pglGetUniformLocation(planetProgram, "glow");
+    planetAtmosphereUniform = pglGetUniformLocation(planetProgram, "atmosphere");
+    planetNightGlowUniform = pglGetUniformLocation(planetProgram, "nightGlow");
+    planetShadeUniform = pglGetUniformLocation(planetProgram, "nightShade");
+}
+
+void drawLitDisc(int index, float px, float py, float r, float sunAngle, float glowAlpha = 0.25f) {
+    const PlanetLighting& l = planetLighting[index];
+    float sunRad = sunAngle * PI / 180.0f;
+    // Without the glow nothing is drawn past the atmosphere rim, so the quad can stop there.
+    float reach = glowAlpha > 0.0f ? LIT_DISC_EXTENT : LIT_DISC_RIM;
+    float extent = r * reach;
+
+    pglUseProgram(planetProgram);
+    pglUniform2f(planetSunUniform, cos(sunRad), sin(sunRad));
+    pglUniform4f(planetGlowUniform, pColors[index][0], pColors[index][1], pColors[index][2], glowAlpha);
+    pglUniform4f(planetAtmosphereUniform, l.atmosphere[0], l.atmosphere[1], l.atmosphere[2], l.atmosphere[3]);
+    pglUniform4f(planetNightGlowUniform, l.nightGlow[0], l.nightGlow[1], l.nightGlow[2], l.nightGlow[3]);
+    pglUniform1f(planetShadeUniform, l.nightShade);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glBegin(GL_QUADS);
+    glTexCoord2f(-reach, -reach);
+    glVertex2f(px - extent, py - extent);
+    glTexCoord2f(reach, -reach);
+    glVertex2f(px + extent, py - extent);
+    glTexCoord2f(reach, reach);
+    glVertex2f(px + extent, py + extent);
+    glTexCoord2f(-reach, reach);
+    glVertex2f(px - extent, py + extent);
+    glEnd();
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    pglUseProgram(0);
+}
+
+const unsigned int ARTIFACT_VERSION = 1;
+const int ARTIFACT_SURFACE = 0;
+const int ARTIFACT_NBODY_BELT = 1;
+const char* const artifactNames[] = {"surface", "nbody"};
+const unsigned long long FNV_OFFSET = 1469598103934665603ULL;
+const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+struct ArtifactHeader {
+    char magic[8];
+    unsigned int version;
+    int kind;
+    unsigned long long key, size, hash;
+};
+
+struct MappedArtifact {
+    const unsigned char* data;
+    size_t size;
+    void* mapping;
+    size_t length;
+};
+
+string cacheDir = "artifact_cache";
+bool cacheEnabled = true;
+unsigned long long cacheLimitBytes = 256ULL << 20;
+int artifactsReused = 0, artifactsRebuilt = 0;
+chrono::steady_clock::time_point launchTime = chrono::steady_clock::now();
+bool firstFrameReported = false;
+
+unsigned long long fnvHash(const void* data, size_t size, unsigned long long hash = FNV_OFFSET) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * FNV_PRIME;
+    return hash;
+}
+
+unsigned long long contentHash(const unsigned char* data, size_t size) {
+    unsigned long long hash = FNV_OFFSET;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; i++) {
+        unsigned long long word;
+        memcpy(&word, data + i * 8, 8);
+        hash = (hash ^ word) * FNV_PRIME;
+    }
+    return fnvHash(data + words * 8, size - words * 8, hash);
+}
+
+string artifactPath(int kind, unsigned long long key) {
+    char name[64];
+    sprintf(name, "/%s-%016llx.bin", artifactNames[kind], key);
+    return cacheDir + name;
+}
+
+void closeArtifact(MappedArtifact& a) {
+#if defined(__unix__) || defined(__APPLE__)
+    if (a.mapping) munmap(a.mapping, a.length);
+#else
+    delete[] (unsigned char*)a.mapping;
+#endif
+    a = {nullptr, 0, nullptr, 0};
+}
+
+bool openArtifact(int kind, unsigned long long key, MappedArtifact& a) {
+    a = {nullptr, 0, nullptr, 0};
+    if (!cacheEnabled) return false;
+    string path = artifactPath(kind, key);
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ArtifactHeader)) {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            a.mapping = mapping;
+            a.length = st.st_size;
+        }
+    }
+    close(fd);
+#else
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (length >= (long)sizeof(ArtifactHeader)) {
+        unsigned char* buffer = new unsigned char[length];
+        a.mapping = buffer;
+        a.length = fread(buffer, 1, length, file);
+    }
+    fclose(file);
+#endif
+    if (!a.mapping) return false;
+
+    const ArtifactHeader* h = (const ArtifactHeader*)a.mapping;
+    bool ok = a.length >= sizeof(ArtifactHeader) && memcmp(h->magic, "SSEART1", 8) == 0 &&
+              h->version == ARTIFACT_VERSION && h->kind == kind && h->key == key &&
+              h->size == a.length - sizeof(ArtifactHeader);
+    if (ok) {
+        a.data = (const unsigned char*)a.mapping + sizeof(ArtifactHeader);
+        a.size = h->size;
+        ok = contentHash(a.data, a.size) == h->hash;
+    }
+    if (!ok) {
+        cerr << "Artifact cache: " << path << " is stale or damaged, rebuilding" << endl;
+        closeArtifact(a);
+        return false;
+    }
+    error_code ec;
+    filesystem::last_write_time(path, filesystem::file_time_type::clock::now(), ec);
+    return true;
+}
+
+// Every pinned seed adds its own belt, so the cache is held to cacheLimitBytes by deleting the
+// artifacts used least recently; a reuse refreshes the file's modification time, which serves as
+// the use stamp. The artifact just written is never evicted.
+void trimArtifactCache(const string& keep) {
+    error_code ec;
+    vector<pair<filesystem::file_time_type, filesystem::path>> files;
+    unsigned long long total = 0;
+    for (const auto& entry : filesystem::directory_iterator(cacheDir, ec)) {
+        if (entry.path().extension() != ".bin" || !entry.is_regular_file(ec)) continue;
+        total += entry.file_size(ec);
+        files.push_back({entry.last_write_time(ec), entry.path()});
+    }
+    if (total <= cacheLimitBytes) return;
+    sort(files.begin(), files.end());
+    for (const auto& file : files) {
+        if (total <= cacheLimitBytes) break;
+        if (file.second == filesystem::path(keep)) continue;
+        unsigned long long size = filesystem::file_size(file.second, ec);
+        if (filesystem::remove(file.second, ec)) total -= size;
+    }
+}
+
+void storeArtifact(int kind, unsigned long long key, const vector<unsigned char>& payload) {
+    if (!cacheEnabled) return;
+    error_code ec;
+    filesystem::create_directories(cacheDir, ec);
+    string path = artifactPath(kind, key), temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) return;
+    ArtifactHeader h = {"SSEART1", ARTIFACT_VERSION, kind, key, payload.size(), contentHash(payload.data(), payload.size())};
+    bool ok = fwrite(&h, sizeof(h), 1, file) == 1 && fwrite(payload.data(), payload.size(), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return;
+    }
+    trimArtifactCache(path);
+}
+
+void reportFirstFrame() {
+    if (firstFrameReported) return;
+    firstFrameReported = true;
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - launchTime).count();
+    cerr << "First frame " << fixed << setprecision(1) << ms << " ms after launch (" << artifactsReused
+         << " artifacts reused, " << artifactsRebuilt << " rebuilt in " << cacheDir << ")" << endl;
+}
+
+const int SURFACE_ROCKY = 0;
+const int SURFACE_BANDED = 1;
+const int SURFACE_OCEAN = 2;
+const int SURFACE_CLOUDS = 3;
+
+struct SurfaceParams {
+    int kind, width, height;
+    unsigned int seed;
+    float base[3], light[3], accent[3];
+    float scale, bands, iceCap, spotLat, spotLon, spotSize;
+};
+
+const int SURFACE_MOON = 8;
+const int SURFACE_EARTH_CLOUDS = 9;
+const int SURFACE_COUNT = 10;
+const unsigned int SURFACE_VERSION = 1;
+
+const SurfaceParams surfaceParams[SURFACE_COUNT] = {
+    {SURFACE_ROCKY, 512, 256, 11, {0.45f, 0.43f, 0.42f}, {0.82f, 0.8f, 0.78f}, {0.3f, 0.28f, 0.27f}, 3.0f, 0, 0, 0, 0, 0},
+    {SURFACE_BANDED, 512, 256, 23, {0.86f, 0.66f, 0.38f}, {0.98f, 0.86f, 0.6f}, {0, 0, 0}, 1.5f, 5, 0, 0, 0, 0},
+    {SURFACE_OCEAN, 512, 256, 31, {0.08f, 0.3f, 0.75f}, {0.22f, 0.55f, 0.22f}, {0.55f, 0.45f, 0.28f}, 2.2f, 0, 0.15f, 0, 0, 0},
+    {SURFACE_ROCKY, 512, 256, 47, {0.68f, 0.25f, 0.1f}, {0.95f, 0.5f, 0.25f}, {0.45f, 0.15f, 0.08f}, 2.5f, 0, 0.15f, 0, 0, 0},
+    {SURFACE_BANDED, 512, 256, 53, {0.72f, 0.52f, 0.36f}, {0.95f, 0.88f, 0.75f}, {0.8f, 0.3f, 0.2f}, 2.0f, 14, 0, -0.35f, 1.2f, 0.16f},
+    {SURFACE_BANDED, 512, 256, 61, {0.85f, 0.74f, 0.48f}, {0.98f, 0.92f, 0.68f}, {0, 0, 0}, 1.5f, 10, 0, 0, 0, 0},
+    {SURFACE_BANDED, 512, 256, 71, {0.55f, 0.85f, 0.88f}, {0.72f, 0.95f, 0.95f}, {0, 0, 0}, 1.0f, 4, 0, 0, 0, 0},
+    {SURFACE_BANDED, 512, 256, 83, {0.25f, 0.35f, 0.85f}, {0.45f, 0.58f, 0.98f}, {0.12f, 0.15f, 0.45f}, 1.5f, 6, 0, -0.3f, 4.0f, 0.12f},
+    {SURFACE_ROCKY, 512, 256, 97, {0.55f, 0.56f, 0.6f}, {0.9f, 0.9f, 0.93f}, {0.4f, 0.41f, 0.45f}, 2.5f, 0, 0, 0, 0, 0},
+    {SURFACE_CLOUDS, 512, 256, 101, {1, 1, 1}, {1, 1, 1}, {0, 0, 0}, 2.5f, 0, 0, 0, 0, 0},
+};
+
+GLuint surfaceTextures[SURFACE_COUNT] = {0};
+bool planetTextures = true;
+vector<float> discVertices, discTexCoords;
+vector<unsigned char> discShades;
+vector<unsigned short> discIndices;
+
+float latticeNoise(int x, int y, int z, unsigned int seed) {
+    unsigned int h = seed ^ (x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u);
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return (h & 0xffffff) / 16777215.0f;
+}
+
+float valueNoise(float x, float y, float z, unsigned int seed) {
+    int ix = (int)floor(x), iy = (int)floor(y), iz = (int)floor(z);
+    float fx = x - ix, fy = y - iy, fz = z - iz;
+    fx = fx * fx * (3 - 2 * fx);
+    fy = fy * fy * (3 - 2 * fy);
+    fz = fz * fz * (3 - 2 * fz);
+    float c[2][2];
+    for (int dz = 0; dz < 2; dz++) {
+        for (int dy = 0; dy < 2; dy++) {
+            float a = latticeNoise(ix, iy + dy, iz + dz, seed);
+            float b = latticeNoise(ix + 1, iy + dy, iz + dz, seed);
+            c[dz][dy] = a + (b - a) * fx;
+        }
+    }
+    float near = c[0][0] + (c[0][1] - c[0][0]) * fy;
+    float far = c[1][0] + (c[1][1] - c[1][0]) * fy;
+    return near + (far - near) * fz;
+}
+
+float fractalNoise(float x, float y, float z, unsigned int seed, int octaves) {
+    float sum = 0.0f, amplitude = 0.5f, total = 0.0f;
+    for (int o = 0; o < octaves; o++) {
+        sum += valueNoise(x, y, z, seed + o * 101) * amplitude;
+        total += amplitude;
+        amplitude *= 0.5f;
+        x *= 2.03f;
+        y *= 2.03f;
+        z *= 2.03f;
+    }
+    return sum / total;
+}
+
+void mixColor(const float* a, const float* b, float t, float* out) {
+    t = min(max(t, 0.0f), 1.0f);
+    for (int k = 0; k < 3; k++) out[k] = a[k] + (b[k] - a[k]) * t;
+}
+
+void surfaceTexel(const SurfaceParams& p, float lon, float lat, unsigned char* out) {
+    float sx = cos(lat) * cos(lon) * p.scale, sy = cos(lat) * sin(lon) * p.scale, sz = sin(lat) * p.scale;
+    float color[3], alpha = 1.0f;
+    float polar = fabs(lat) / (PI / 2);
+
+    if (p.kind == SURFACE_ROCKY) {
+        float n = fractalNoise(sx, sy, sz, p.seed, 5);
+        float detail = fractalNoise(sx * 4, sy * 4, sz * 4, p.seed + 7, 3);
+        mixColor(p.base, p.light, n * 1.6f - 0.3f, color);
+        if (detail < 0.35f) mixColor(color, p.accent, (0.35f - detail) * 4.0f, color);
+        for (int k = 0; k < 3; k++) color[k] *= 0.85f + 0.3f * detail;
+    } else if (p.kind == SURFACE_BANDED) {
+        float warp = fractalNoise(sx, sy, sz * 3, p.seed, 4);
+        float band = 0.5f + 0.5f * sin(lat * p.bands + (warp - 0.5f) * 4.0f);
+        float streak = fractalNoise(sx * 6, sy * 6, sz * 24, p.seed + 3, 2);
+        mixColor(p.base, p.light, band * 0.8f + streak * 0.3f - 0.05f, color);
+        if (p.spotSize > 0) {
+            float dlon = fmod(fabs(lon - p.spotLon), 2 * PI);
+            dlon = min(dlon, 2 * PI - dlon);
+            float d = sqrt(dlon * dlon * 0.3f + (lat - p.spotLat) * (lat - p.spotLat)) / p.spotSize;
+            if (d < 1.0f) mixColor(color, p.accent, (1.0f - d * d) * 1.5f, color);
+        }
+    } else if (p.kind == SURFACE_OCEAN) {
+        float h = fractalNoise(sx, sy, sz, p.seed, 6);
+        if (h > 0.53f) {
+            mixColor(p.light, p.accent, (h - 0.53f) * 5.0f, color);
+        } else {
+            float deep[3] = {p.base[0] * 0.5f, p.base[1] * 0.5f, p.base[2] * 0.6f};
+            mixColor(deep, p.base, h / 0.53f, color);
+        }
+    } else {
+        float c = fractalNoise(sx, sy * 1.5f, sz * 3, p.seed, 5);
+        color[0] = color[1] = color[2] = 1.0f;
+        alpha = min(max((c - 0.5f) * 3.5f, 0.0f), 1.0f) * 0.85f;
+    }
+
+    if (p.iceCap > 0) {
+        float edge = 1.0f - p.iceCap + (fractalNoise(sx * 2, sy * 2, sz * 2, p.seed + 11, 3) - 0.5f) * 0.3f;
+        if (polar > edge) {
+            float ice[3] = {0.93f, 0.95f, 1.0f};
+            mixColor(color, ice, (polar - edge) * 30.0f, color);
+        }
+    }
+    for (int k = 0; k < 3; k++) out[k] = colorByte(color[k]);
+    out[3] = colorByte(alpha);
+}
+
+void bakeSurface(const SurfaceParams& p, vector<unsigned char>& pixels) {
+    pixels.resize(p.width * p.height * 4);
+    parallelFor(p.width * p.height, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float lon = 2 * PI * ((i % p.width) + 0.5f) / p.width;
+            float lat = PI * (((i / p.width) + 0.5f) / p.height - 0.5f);
+            surfaceTexel(p, lon, lat, &pixels[(size_t)i * 4]);
+        }
+    });
+}
+
+unsigned long long surfaceKey(const SurfaceParams& p) {
+    return (fnvHash(&p, sizeof(SurfaceParams)) ^ SURFACE_VERSION) * FNV_PRIME;
+}
+
+void buildDiscMesh() {
+    const int rings = 10, segments = 40;
+    discVertices = {0.0f, 0.0f};
+    discTexCoords = {0.0f, 0.5f};
+    discShades = {255, 255, 255, 255};
+    for (int k = 1; k <= rings; k++) {
+        float rho = sin(PI / 2 * k / rings);
+        unsigned char shade = colorByte(0.55f + 0.45f * sqrt(max(0.0f, 1.0f - rho * rho)));
+        for (int s = 0; s < segments; s++) {
+            float theta = 2 * PI * s / segments;
+            float u = rho * cos(theta), v = rho * sin(theta);
+            float lat = asin(v);
+            float lon = asin(min(max(u / max(cos(lat), 1e-6f), -1.0f), 1.0f));
+            discVertices.insert(discVertices.end(), {u, v});
+            discTexCoords.insert(discTexCoords.end(), {lon / (2 * PI), lat / PI + 0.5f});
+            discShades.insert(discShades.end(), {shade, shade, shade, 255});
+        }
+    }
+    discIndices.clear();
+    for (int s = 0; s < segments; s++) {
+        int n = (s + 1) % segments;
+        discIndices.insert(discIndices.end(), {0, (unsigned short)(1 + s), (unsigned short)(1 + n)});
+    }
+    for (int k = 1; k < rings; k++) {
+        int inner = 1 + (k - 1) * segments, outer = 1 + k * segments;
+        for (int s = 0; s < segments; s++) {
+            int n = (s + 1) % segments;
+            discIndices.insert(discIndices.end(), {(unsigned short)(inner + s), (unsigned short)(outer + s),
+                                                   (unsigned short)(outer + n), (unsigned short)(inner + s),
+                                                   (unsigned short)(outer + n), (unsigned short)(inner + n)});
+        }
+    }
+}
+
+void loadPlanetTextures() {
+    auto start = chrono::steady_clock::now();
+    buildDiscMesh();
+    glGenTextures(SURFACE_COUNT, surfaceTextures);
+    int cached = 0;
+    vector<unsigned char> pixels;
+    for (int i = 0; i < SURFACE_COUNT; i++) {
+        const SurfaceParams& p = surfaceParams[i];
+        unsigned long long key = surfaceKey(p);
+        MappedArtifact artifact;
+        const unsigned char* texels;
+        if (openArtifact(ARTIFACT_SURFACE, key, artifact) && artifact.size == (size_t)p.width * p.height * 4) {
+            texels = artifact.data;
+            cached++;
+        } else {
+            closeArtifact(artifact);
+            bakeSurface(p, pixels);
+            storeArtifact(ARTIFACT_SURFACE, key, pixels);
+            texels = pixels.data();
+        }
+        glBindTexture(GL_TEXTURE_2D, surfaceTextures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA, p.width, p.height, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        closeArtifact(artifact);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    artifactsReused += cached;
+    artifactsRebuilt += SURFACE_COUNT - cached;
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cerr << "Planet textures: " << SURFACE_COUNT << " ready in " << fixed << setprecision(1) << ms << " ms ("
+         << cached << " from " << cacheDir << ")" << endl;
+}
+
+void drawSurface(int surface, float x, float y, float r, float spinDeg, float tiltDeg) {
+    glPushMatrix();
+    glTranslatef(x, y, 0);
+    glRotatef(tiltDeg, 0, 0, 1);
+    glScalef(r, r, 1);
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glTranslatef(spinDeg / 360.0f, 0, 0);
+    glMatrixMode(GL_MODELVIEW);
+
+    glEnable(GL_BLEND);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, surfaceTextures[surface]);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, discVertices.data());
+    glTexCoordPointer(2, GL_FLOAT, 0, discTexCoords.data());
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, discShades.data());
+    glDrawElements(GL_TRIANGLES, discIndices.size(), GL_UNSIGNED_SHORT, discIndices.data());
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_TEXTURE_2D);
+
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+}
 
-    float dx = moonX - earthX;
-    float dy = moonY - earthY;
-    float dist = sqrt(dx * dx + dy * dy);
+void drawAtmosphereShell(float cx, float cy, float r) {
+    const int layers = 12, segments = 64;
+    float alpha[layers + 1];
+    alpha[layers] = 0.0f;
+    for (int i = layers - 1; i >= 0; i--) alpha[i] = alpha[i + 1] + (1.0f - (float)i / layers) * 0.12f;
 
-    if (dist < 0.15f) {
-        glEnable(GL_BLEND);
-        glColor4f(0, 0, 0, 0.6f);
-        drawCircle(moonX, moonY, moonR * 0.8f, 25);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    glBegin(GL_QUADS);
+    for (int k = -1; k < layers; k++) {
+        float r0 = k < 0 ? r : r * (1.08f + 0.25f * k / layers);
+        float r1 = r * (1.08f + 0.25f * (k + 1) / layers);
+        float a0 = alpha[max(k, 0)], a1 = alpha[k + 1];
+        for (int s = 0; s < segments; s++) {
+            float t0 = 2 * PI * s / segments, t1 = 2 * PI * (s + 1) / segments;
+            glColor4f(0.2f, 0.5f, 1.0f, a0);
+            glVertex2f(cx + r0 * cos(t0), cy + r0 * sin(t0));
+            glVertex2f(cx + r0 * cos(t1), cy + r0 * sin(t1));
+            glColor4f(0.2f, 0.5f, 1.0f, a1);
+            glVertex2f(cx + r1 * cos(t1), cy + r1 * sin(t1));
+            glVertex2f(cx + r1 * cos(t0), cy + r1 * sin(t0));
+        }
     }
+    glEnd();
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
 void drawPlanetWithMoons(int index, float px, float py, bool isZoomed = false) {
     float sunAngle = atan2(py, px) * 180.0f / PI + 180;
+    bool legacyLighting = planetProgram == 0;
 
-    drawGlow(px, py, planetSizes[index], pColors[index][0], pColors[index][1], pColors[index][2], 0.25f);
+    if (legacyLighting) {
+        drawGlow(px, py, planetSizes[index], pColors[index][0], pColors[index][1], pColors[index][2], 0.25f);
+    }
 
-    if (index == 2) {
+    if (surfaceTextures[index]) {
+        if (index == 2 && legacyLighting) drawAtmosphere(px, py, planetSizes[index]);
+        drawSurface(index, px, py, planetSizes[index], sim.planetRotation[index], index == 6 ? 98.0f : 0.0f);
+        if (index == 2) {
+            drawSurface(SURFACE_EARTH_CLOUDS, px, py, planetSizes[index], sim.cloudAngle, 0.0f);
+            if (legacyLighting) drawDayNightMask(px, py, planetSizes[index], sunAngle);
+        } else if (legacyLighting) {
+            drawPlanetShadow(px, py, planetSizes[index], sunAngle);
+        }
+    } else if (index == 2) {
      
-        drawAtmosphere(px, py, planetSizes[index]);
+        if (legacyLighting) drawAtmosphere(px, py, planetSizes[index]);
         
         glColor3f(pColors[index][0], pColors[index][1], pColors[index][2]);
         drawCircle(px, py, planetSizes[index], 35);
@@ -481,14 +3606,14 @@ void drawPlanetWithMoons(int index, float px, float py, bool isZoomed = false) {
        
         glPushMatrix();
         glTranslatef(px, py, 0);
-        glRotatef(planetRotation[index], 0, 0, 1);
+        glRotatef(sim.planetRotation[index], 0, 0, 1);
         glColor4f(0.2f, 0.6f, 0.2f, 0.8f);
         drawEllipse(planetSizes[index] * 0.3f, planetSizes[index] * 0.2f, 
                    planetSizes[index] * 0.3f, planetSizes[index] * 0.2f, 12);
         glPopMatrix();
         
-        drawCloudLayer(px, py, planetSizes[index], cloudAngle);
-        drawDayNightMask(px, py, planetSizes[index], sunAngle);
+        drawCloudLayer(px, py, planetSizes[index], sim.cloudAngle);
+        if (legacyLighting) drawDayNightMask(px, py, planetSizes[index], sunAngle);
     } else {
         glColor3f(pColors[index][0], pColors[index][1], pColors[index][2]);
         drawCircle(px, py, planetSizes[index], 35);
@@ -497,25 +3622,26 @@ void drawPlanetWithMoons(int index, float px, float py, bool isZoomed = false) {
            
             glPushMatrix();
             glTranslatef(px, py, 0);
-            glRotatef(planetRotation[index], 0, 0, 1);
+            glRotatef(sim.planetRotation[index], 0, 0, 1);
             glColor4f(1, 1, 1, 0.7f);
             drawCircle(0, planetSizes[index] * 0.8f, planetSizes[index] * 0.15f, 12);
             drawCircle(0, -planetSizes[index] * 0.8f, planetSizes[index] * 0.12f, 12);
             glPopMatrix();
         }
         
-        if (index == 4) drawJupiterSpot(px, py, planetSizes[index], planetRotation[index]);
-        if (index == 6) drawUranusTilt(px, py, planetSizes[index], planetRotation[index]);
+        if (index == 4) drawJupiterSpot(px, py, planetSizes[index], sim.planetRotation[index]);
+        if (index == 6) drawUranusTilt(px, py, planetSizes[index], sim.planetRotation[index]);
         
-        drawPlanetShadow(px, py, planetSizes[index], sunAngle);
+        if (legacyLighting) drawPlanetShadow(px, py, planetSizes[index], sunAngle);
     }
+    if (!legacyLighting) drawLitDisc(index, px, py, planetSizes[index], sunAngle);
 
     
     if (index == 5) {
         drawAnimatedRing(px, py, planetSizes[index] * 1.3f, planetSizes[index] * 2.0f, 80,
-                        0.9f, 0.8f, 0.6f, 0.7f, ringAngle[index]);
+                        0.9f, 0.8f, 0.6f, 0.7f, sim.ringAngle[index]);
         drawAnimatedRing(px, py, planetSizes[index] * 2.05f, planetSizes[index] * 2.3f, 80,
-                        0.8f, 0.7f, 0.5f, 0.5f, ringAngle[index] * 0.8f);
+                        0.8f, 0.7f, 0.5f, 0.5f, sim.ringAngle[index] * 0.8f);
     }
 
  
@@ -528,18 +3654,21 @@ void drawPlanetWithMoons(int index, float px, float py, bool isZoomed = false) {
         glPopMatrix();
     }
 
-    
-    for (int m = 0; m < moonCounts[index]; m++) {
-        float moonOrbit = planetSizes[index] * (2.0f + m * 0.8f);
-        float moonAngleCalc = angleAll * (2.0f - m * 0.3f) + m * 60;
-        float moonRad = moonAngleCalc * PI / 180.0f;
-        float mx = px + moonOrbit * cos(moonRad);
-        float my = py + moonOrbit * sin(moonRad);
-        float moonSize = planetSizes[index] * (0.15f + m * 0.05f);
+    const TransformGraph& g = frameTransforms;
+    int firstMoon = moonNodes[index], lastMoon = firstMoon + moonCounts[index];
+    float sunR = 0.12f + 0.008f * sin(sim.sunPulse);
+    for (int n = firstMoon; n < lastMoon; n++) {
+        drawEclipseShadow(px, py, planetSizes[index], px + g.localX[n], py + g.localY[n], g.radius[n], sunR);
+    }
+
+    for (int n = firstMoon; n < lastMoon; n++) {
+        float mx = px + g.localX[n];
+        float my = py + g.localY[n];
+        float moonSize = g.radius[n];
         
         if (isZoomed) {
             glColor4f(0.4f, 0.4f, 0.5f, 0.2f);
-            drawCircle(px, py, moonOrbit, 50, true);
+            drawCircle(px, py, g.orbit[n], 50, true);
         }
         
         glColor4f(0.7f, 0.7f, 0.75f, 1.0f);
@@ -547,6 +3676,8 @@ void drawPlanetWithMoons(int index, float px, float py, bool isZoomed = false) {
         
         glColor4f(0.5f, 0.5f, 0.55f, 0.6f);
         drawCircle(mx + moonSize * 0.2f, my + moonSize * 0.1f, moonSize * 0.2f, 8);
+
+        drawEclipseShadow(mx, my, moonSize, px, py, planetSizes[index], sunR);
     }
 }
 
@@ -579,10 +3710,10 @@ void drawComet(float x, float y) {
     drawCircle(x, y, 0.012f, 15);
 }
 
-void drawPluto(float angle) {
-    float rad = angle * PI / 180.0f;
-    float px = plutoDistance * cos(rad);
-    float py = plutoDistance * sin(rad);
+void drawPluto() {
+    const TransformGraph& g = frameTransforms;
+    float px = g.worldX[plutoNode];
+    float py = g.worldY[plutoNode];
 
     glEnable(GL_BLEND);
     glColor4f(0.4f, 0.3f, 0.3f, 0.3f);
@@ -597,28 +3728,8 @@ void drawPluto(float angle) {
     glColor3f(0.85f, 0.75f, 0.65f);
     drawCircle(px, py, plutoSize, 12);
 
-    float charonAngle = angle * 3;
-    float charonRad = charonAngle * PI / 180.0f;
-    float cx = px + plutoSize * 2.5f * cos(charonRad);
-    float cy = py + plutoSize * 2.5f * sin(charonRad);
     glColor3f(0.6f, 0.6f, 0.65f);
-    drawCircle(cx, cy, plutoSize * 0.5f, 8);
-}
-
-void drawShootingStar() {
-    if (!showMeteor) return;
-
-    glEnable(GL_BLEND);
-    glBegin(GL_TRIANGLES);
-    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-    glVertex2f(meteorX, meteorY);
-    glColor4f(0.5f, 0.7f, 1.0f, 0.0f);
-    glVertex2f(meteorX - 0.15f, meteorY + 0.05f);
-    glVertex2f(meteorX - 0.12f, meteorY + 0.08f);
-    glEnd();
-
-    glColor4f(1.0f, 1.0f, 1.0f, 0.9f);
-    drawCircle(meteorX, meteorY, 0.005f, 8);
+    drawCircle(g.worldX[charonNode], g.worldY[charonNode], g.radius[charonNode], 8);
 }
 
 void drawText(const char* text, float x, float y) {
@@ -629,7 +3740,49 @@ void drawText(const char* text, float x, float y) {
     }
 }
 
+void describeEclipse(const EclipseEvent& e, char* text) {
+    const char* depths[] = {"PENUMBRAL", "PARTIAL", "TOTAL"};
+    const char* planet = planetNames[e.planet].c_str();
+    if (e.kind == EVENT_SUN_TRANSIT) {
+        sprintf(text, "%s TRANSITS THE SUN", planet);
+    } else if (e.kind == EVENT_MOON_ECLIPSE) {
+        sprintf(text, "%s ECLIPSE OF MOON %d OF %s", depths[e.depth], e.moon + 1, planet);
+    } else {
+        sprintf(text, "%s SHADOW OF MOON %d ON %s", depths[e.depth], e.moon + 1, planet);
+    }
+}
+
+void drawEclipsePanel() {
+    const vector<EclipseEvent>& events = frameView->eclipses;
+    glColor4f(1.0f, 0.8f, 0.0f, 0.9f);
+    drawText("UPCOMING ECLIPSES AND TRANSITS", -0.95f, -0.62f);
+    if (timeWarp > 1.0f) {
+        drawText("Paused during time warp", -0.95f, -0.68f);
+        return;
+    }
+    if (events.empty()) {
+        drawText("Searching...", -0.95f, -0.68f);
+        return;
+    }
+    float ticksPerAngle = 1.0f / (0.5f * speedMultiplier);
+    for (size_t i = 0; i < events.size(); i++) {
+        const EclipseEvent& e = events[i];
+        char what[96];
+        const char* line;
+        describeEclipse(e, what);
+        if (e.start <= sim.angleAll) {
+            line = arenaPrintf("NOW      %s", what);
+            glColor4f(1.0f, 0.6f, 0.2f, 1.0f);
+        } else {
+            line = arenaPrintf("%6.1f s  %s", (e.start - sim.angleAll) * ticksPerAngle / 60.0f, what);
+            glColor4f(0.9f, 0.9f, 0.8f, 0.9f);
+        }
+        drawText(line, -0.95f, -0.68f - i * 0.05f);
+    }
+}
+
 void drawHUD() {
+    if (drawingTile) return;
     glEnable(GL_BLEND);
 
    
@@ -680,8 +3833,35 @@ void drawHUD() {
     glVertex2f(0.8f, 0.99f);
     glVertex2f(0.58f, 0.99f);
     glEnd();
+    if (timeWarp > 1.0f) {
+        glColor4f(1.0f, 0.7f, 0.3f, 0.9f);
+        drawText(arenaPrintf("TIME WARP %.0fX", timeWarp), 0.58f, 0.89f);
+    }
+
+    if (showPacingStats) {
+        const char* paceNames[] = {"VSYNC", "TARGET", "UNCAPPED"};
+        const char* pacing = arenaPrintf("%s %.1f FPS  JITTER %.2f MS  WORST %.1f MS  Q%d%s", paceNames[paceMode],
+                paceMeanMs > 0.0f ? 1000.0f / paceMeanMs : 0.0f, paceJitterMs, paceWorstMs,
+                qualityTier, qualityAuto ? " AUTO" : "");
+        glColor4f(0.6f, 0.8f, 0.9f, 0.9f);
+        drawText(pacing, -0.42f, 0.945f);
+
+        char latency[160];
+        int length = sprintf(latency, "INPUT TO PHOTON P50/P95/P99 MS");
+        bool measured = false;
+        for (int k = 0; k < LATENCY_KINDS; k++) {
+            const LatencyStats& stats = latencyStats[k];
+            if (stats.count == 0) continue;
+            length += sprintf(latency + length, "  %s %.0f/%.0f/%.0f", latencyNames[k], stats.p50, stats.p95, stats.p99);
+            measured = true;
+        }
+        if (measured) {
+            glColor4f(0.6f, 0.8f, 0.9f, 0.7f);
+            drawText(latency, 0.1f, -0.96f);
+        }
+    }
+
 
-   
     if (eclipseMode) {
         glColor4f(1.0f, 0.8f, 0.0f, 0.8f);
         glBegin(GL_QUADS);
@@ -690,6 +3870,8 @@ void drawHUD() {
         glVertex2f(0.90f, 0.98f);
         glVertex2f(0.82f, 0.98f);
         glEnd();
+
+        if (currentFrame == 1) drawEclipsePanel();
     }
 
   
@@ -753,24 +3935,101 @@ void drawHelpOverlay() {
     drawText("E: Eclipse Mode", -0.65f, 0.12f);
     drawText("0-7: Pause Planets", -0.65f, 0.0f);
     drawText("Z: Zoom Planet", -0.65f, -0.12f);
-    drawText("ESC: Exit", -0.65f, -0.24f);
+    drawText("N: N-Body Gravity Mode", -0.65f, -0.24f);
+    drawText("I: Leapfrog / Symplectic Euler", -0.65f, -0.36f);
+    drawText("[ / ]: Rewind / Skip 5 Seconds", -0.65f, -0.48f);
+    drawText("Click: Select Body", -0.65f, -0.6f);
+    drawText("ESC: Exit", -0.65f, -0.72f);
+    drawText("V: Vsync / Target / Uncapped", 0.05f, 0.6f);
+    drawText("Q: Adaptive / Fixed Quality", 0.05f, 0.48f);
+    drawText("T: Orbit Trails", 0.05f, 0.36f);
+    drawText("M: Four-Scene Multi-View", 0.05f, 0.24f);
+    drawText(", / .: Time Warp Down / Up", 0.05f, 0.12f);
+}
+
+
+void drawSelection() {
+    if (selectedBody < 0) return;
+    const Body& b = frameView->selected;
+
+    glEnable(GL_BLEND);
+    glColor4f(0.0f, 0.8f, 1.0f, 0.8f);
+    drawCircle(b.x, b.y, max(b.radius * 1.6f, 0.015f), 30, true);
+
+    char label[64];
+    switch (b.kind) {
+        case BODY_SUN: sprintf(label, "SUN"); break;
+        case BODY_PLANET: sprintf(label, "%s", planetNames[b.index].c_str()); break;
+        case BODY_MOON:
+            if (b.parent <= 8) sprintf(label, "MOON %d OF %s", b.index + 1, planetNames[b.parent - 1].c_str());
+            else sprintf(label, "CHARON");
+            break;
+        case BODY_DWARF: sprintf(label, b.index == 0 ? "CERES" : "PLUTO"); break;
+        case BODY_COMET: sprintf(label, "COMET"); break;
+        default: sprintf(label, "ASTEROID #%d", b.index + 1); break;
+    }
+    glColor3f(0.0f, 0.8f, 1.0f);
+    drawText(label, b.x + 0.02f, b.y + max(b.radius, 0.01f) + 0.02f);
 }
 
+void cameraTarget(int scene, int& target, float& x, float& y, float& zoom) {
+    target = -1;
+    x = y = 0.0f;
+    zoom = 1.0f;
+    if (scene == 1 && selectedBody >= 0) {
+        const Body& b = frameView->selected;
+        target = selectedBody;
+        x = b.x;
+        y = b.y;
+        zoom = min(max(0.15f / max(b.radius, 0.005f), 1.5f), 12.0f);
+    } else if (scene == 2 && zoomPlanetIndex >= 0) {
+        int i = zoomPlanetIndex;
+        target = i;
+        x = frameTransforms.worldX[planetNodes[i]];
+        y = frameTransforms.worldY[planetNodes[i]];
+        zoom = min(0.8f / (planetSizes[i] * max(2.6f, 1.6f + moonCounts[i] * 0.8f)), 12.0f);
+    }
+}
+
+void updateCameras(float dt) {
+    for (int scene = 1; scene <= 2; scene++) {
+        Camera& c = cameras[scene];
+        int target;
+        float tx, ty, tzoom;
+        cameraTarget(scene, target, tx, ty, tzoom);
+        if (target != c.target) {
+            c.target = target;
+            c.fromX = c.x;
+            c.fromY = c.y;
+            c.fromZoom = c.zoom;
+            c.transition = scene == 2 && target < 0 ? 1.0f : 0.0f;
+        }
+        c.transition = min(c.transition + dt / CAMERA_TRANSITION_SECONDS, 1.0f);
+        float e = c.transition * c.transition * (3.0f - 2.0f * c.transition);
+        c.x = c.fromX + (tx - c.fromX) * e;
+        c.y = c.fromY + (ty - c.fromY) * e;
+        c.zoom = c.fromZoom * pow(tzoom / c.fromZoom, e);
+    }
+}
 
 void drawFrame1() {
     drawStars();
-    drawSpaceDust();
-    drawShootingStar();
+    drawParticles(frameView->dust, qualityTiers[qualityTier].particleStride);
+    drawParticles(frameView->shootingStars);
 
-  
-    drawComet(cometX, 0.75f + 0.05f * sin(cometX * 3));
+    const Camera& cam = cameras[1];
+    glPushMatrix();
+    applyCamera(cam);
 
-    float sunRadius = 0.12f + 0.008f * sin(sunPulse);
+    drawParticles(frameView->cometTail);
+    drawComet(frameView->cometX, frameView->cometY);
 
-    drawHeatwave(0, 0, sunRadius, heatwavePhase);
-    drawCorona(0, 0, sunRadius, coronaAngle);
-    drawSolarFlares(0, 0, sunRadius, angleAll);
-    drawSunRays(0, 0, sunRadius * 1.3f, angleAll * 0.01f);
+    float sunRadius = 0.12f + 0.008f * sin(sim.sunPulse);
+
+    drawHeatwave(0, 0, sunRadius, sim.heatwavePhase);
+    drawCorona(0, 0, sunRadius, sim.coronaAngle);
+    drawSolarFlares(0, 0, sunRadius, sim.effectTime);
+    drawSunRays(0, 0, sunRadius * 1.3f, sim.effectTime * 0.01f);
 
     drawGlow(0, 0, sunRadius, 1.0f, 0.7f, 0.0f, 0.5f);
     drawGlow(0, 0, sunRadius * 0.8f, 1.0f, 0.9f, 0.3f, 0.4f);
@@ -781,15 +4040,16 @@ void drawFrame1() {
  
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    float emissionPulse = 0.1f + 0.05f * sin(sunPulse * 2);
+    float emissionPulse = 0.1f + 0.05f * sin(sim.sunPulse * 2);
     glColor4f(1.0f, 0.9f, 0.5f, emissionPulse);
     drawCircle(0, 0, sunRadius * 1.8f, 50);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    drawSunspots(0, 0, sunRadius, planetRotation[0]);
+    drawSunspots(0, 0, sunRadius, sim.planetRotation[0]);
 
   
     drawAsteroidBelt();
+    drawTrails();
 
 
     for (int i = 0; i < 8; i++) {
@@ -800,10 +4060,9 @@ void drawFrame1() {
         drawOrbit(distances[i], 100);
         
       
-        float angle = angleAll * speeds[i];
-        float rad = angle * PI / 180.0f;
-        float px = distances[i] * cos(rad);
-        float py = distances[i] * sin(rad);
+        float px = frameTransforms.worldX[planetNodes[i]];
+        float py = frameTransforms.worldY[planetNodes[i]];
+        if (!cameraVisible(cam, px, py, planetSizes[i] * 5.0f)) continue;
         
         drawPlanetWithMoons(i, px, py, false);
         
@@ -815,8 +4074,10 @@ void drawFrame1() {
     }
 
   
-    drawPluto(angleAll * plutoSpeed);
+    drawPluto();
 
+    drawSelection();
+    glPopMatrix();
     drawHUD();
 }
 
@@ -827,7 +4088,7 @@ void drawFrame2() {
         
        
         glColor3f(1.0f, 1.0f, 1.0f);
-        drawText("SELECT A PLANET (0-7) TO ZOOM IN", -0.4f, 0.85f);
+        drawText("CLICK A PLANET OR PRESS F1-F8 TO ZOOM IN", -0.45f, 0.85f);
         drawText("Press Z to return to normal view", -0.35f, 0.75f);
         
        
@@ -844,21 +4105,20 @@ void drawFrame2() {
             glColor3f(0.9f, 0.9f, 1.0f);
             drawText(planetNames[i].c_str(), px - 0.08f, py + 0.15f);
             
-            char keyText[10];
-            sprintf(keyText, "[%d]", i);
-            drawText(keyText, px - 0.03f, py - 0.15f);
+            drawText(arenaPrintf("[%d]", i), px - 0.03f, py - 0.15f);
         }
     } else {
         drawStars();
         
-        float angle = angleAll * speeds[zoomPlanetIndex];
-        float rad = angle * PI / 180.0f;
-        float px = 0.0f;
-        float py = 0.0f;
-        
-        float zoomSize = planetSizes[zoomPlanetIndex] * 5.0f;
+        float px = frameTransforms.worldX[planetNodes[zoomPlanetIndex]];
+        float py = frameTransforms.worldY[planetNodes[zoomPlanetIndex]];
         
+        glPushMatrix();
+        applyCamera(cameras[2]);
+        glColor4f(0.25f, 0.3f, 0.35f, 0.25f);
+        drawOrbit(distances[zoomPlanetIndex], 360);
         drawPlanetWithMoons(zoomPlanetIndex, px, py, true);
+        glPopMatrix();
         
    
         glColor3f(1.0f, 1.0f, 0.5f);
@@ -866,11 +4126,8 @@ void drawFrame2() {
         glColor3f(0.8f, 0.9f, 1.0f);
         drawText(planetFacts[zoomPlanetIndex].c_str(), -0.8f, 0.75f);
         
-        char info[100];
-        sprintf(info, "Distance from Sun: %.2f AU", distances[zoomPlanetIndex]);
-        drawText(info, -0.8f, 0.65f);
-        sprintf(info, "Moons: %d", moonCounts[zoomPlanetIndex]);
-        drawText(info, -0.8f, 0.55f);
+        drawText(arenaPrintf("Distance from Sun: %.2f AU", distances[zoomPlanetIndex]), -0.8f, 0.65f);
+        drawText(arenaPrintf("Moons: %d", moonCounts[zoomPlanetIndex]), -0.8f, 0.55f);
         
         glColor3f(0.5f, 0.8f, 0.5f);
         drawText("Press Z to exit zoom mode", -0.3f, -0.85f);
@@ -880,70 +4137,7 @@ void drawFrame2() {
 }
 
 
-void drawFrame3() {
-   
-    glEnable(GL_BLEND);
-    for (auto& s : stars) {
-        float twinkle = 0.5f + 0.5f * sin(angleAll * s.twinkleSpeed * 2.0f + s.x * 10);
-        float brightness = s.brightness * twinkle;
-        float r = brightness * (0.9f + 0.1f * sin(s.x * 100));
-        float g = brightness * (0.85f + 0.15f * sin(s.y * 80));
-        float b = brightness * (1.0f + 0.1f * cos(s.x * 50));
-        glColor4f(r, g, b, 1.0f);
-        glPointSize(1.0f + brightness * 1.5f);
-        glBegin(GL_POINTS);
-        glVertex2f(s.x, s.y);
-        glEnd();
-    }
-
-  
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    for (int i = 0; i < 5; i++) {
-        float nx = -0.3f + i * 0.15f;
-        float ny = 0.7f + sin(i * 1.0f) * 0.1f;
-        float nr = 0.08f + i * 0.02f;
-        glColor4f(0.3f + i * 0.1f, 0.1f, 0.4f + i * 0.05f, 0.05f);
-        drawCircle(nx, ny, nr, 20);
-    }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-   
-    float sunBgX = -0.75f, sunBgY = 0.65f;
-    drawGlow(sunBgX, sunBgY, 0.15f, 1.0f, 0.8f, 0.3f, 0.5f);
-    glColor3f(1.0f, 0.95f, 0.5f);
-    drawCircle(sunBgX, sunBgY, 0.06f, 35);
-
-   
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    for (int i = 1; i <= 5; i++) {
-        float flareX = sunBgX + (0 - sunBgX) * i * 0.2f;
-        float flareY = sunBgY + (0 - sunBgY) * i * 0.2f;
-        float flareSize = 0.02f + (i % 3) * 0.01f;
-        float alpha = 0.15f / i;
-        glColor4f(1.0f, 0.7f + i * 0.05f, 0.3f, alpha);
-        drawCircle(flareX, flareY, flareSize, 15);
-    }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-   
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    for (int i = 0; i < 12; i++) {
-        float angle = i * PI / 6 + angleAll * 0.008f;
-        glBegin(GL_TRIANGLES);
-        glColor4f(1.0f, 0.9f, 0.5f, 0.35f);
-        glVertex2f(sunBgX + 0.06f * cos(angle - 0.04f), sunBgY + 0.06f * sin(angle - 0.04f));
-        glVertex2f(sunBgX + 0.06f * cos(angle + 0.04f), sunBgY + 0.06f * sin(angle + 0.04f));
-        glColor4f(1.0f, 0.7f, 0.2f, 0.0f);
-        glVertex2f(sunBgX + 0.22f * cos(angle), sunBgY + 0.22f * sin(angle));
-        glEnd();
-    }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-   
-    float earthX = 0.0f, earthY = -0.1f;
-    float earthRadius = 0.28f;
-
-    
+void drawEarthPolygons(float earthX, float earthY, float earthRadius) {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE);
     for (int i = 0; i < 12; i++) {
         float ratio = (float)i / 12;
@@ -970,7 +4164,7 @@ void drawFrame3() {
     glColor4f(0.05f, 0.2f, 0.5f, 0.45f);
     glPushMatrix();
     glTranslatef(earthX, earthY, 0);
-    glRotatef(planetRotation[2] * 0.22f, 0, 0, 1);
+    glRotatef(sim.planetRotation[2] * 0.22f, 0, 0, 1);
     drawEllipse(-earthRadius * 0.5f, 0, earthRadius * 0.3f, earthRadius * 0.4f, 20);
     drawEllipse(earthRadius * 0.3f, earthRadius * 0.2f, earthRadius * 0.25f, earthRadius * 0.3f, 18);
     glPopMatrix();
@@ -1077,10 +4271,85 @@ void drawFrame3() {
     glColor4f(1.0f, 1.0f, 1.0f, 0.18f);
     glPushMatrix();
     glTranslatef(earthX, earthY, 0);
-    glRotatef(cloudAngle * 1.3f, 0, 0, 1);
+    glRotatef(sim.cloudAngle * 1.3f, 0, 0, 1);
     drawEllipse(earthRadius * 0.22f, earthRadius * 0.42f, earthRadius * 0.38f, earthRadius * 0.12f, 22);
     drawEllipse(-earthRadius * 0.35f, earthRadius * 0.12f, earthRadius * 0.42f, earthRadius * 0.14f, 22);
     glPopMatrix();
+}
+
+void drawFrame3() {
+   
+    glEnable(GL_BLEND);
+    for (auto& s : stars) {
+        float twinkle = 0.5f + 0.5f * sin(sim.effectTime * s.twinkleSpeed * 2.0f + s.x * 10);
+        float brightness = s.brightness * twinkle;
+        float r = brightness * (0.9f + 0.1f * sin(s.x * 100));
+        float g = brightness * (0.85f + 0.15f * sin(s.y * 80));
+        float b = brightness * (1.0f + 0.1f * cos(s.x * 50));
+        glColor4f(r, g, b, 1.0f);
+        glPointSize(1.0f + brightness * 1.5f);
+        glBegin(GL_POINTS);
+        glVertex2f(s.x, s.y);
+        glEnd();
+    }
+
+  
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    for (int i = 0; i < 5; i++) {
+        float nx = -0.3f + i * 0.15f;
+        float ny = 0.7f + sin(i * 1.0f) * 0.1f;
+        float nr = 0.08f + i * 0.02f;
+        glColor4f(0.3f + i * 0.1f, 0.1f, 0.4f + i * 0.05f, 0.05f);
+        drawCircle(nx, ny, nr, 20);
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+   
+    float sunBgX = -0.75f, sunBgY = 0.65f;
+    drawGlow(sunBgX, sunBgY, 0.15f, 1.0f, 0.8f, 0.3f, 0.5f);
+    glColor3f(1.0f, 0.95f, 0.5f);
+    drawCircle(sunBgX, sunBgY, 0.06f, 35);
+
+   
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    for (int i = 1; i <= 5; i++) {
+        float flareX = sunBgX + (0 - sunBgX) * i * 0.2f;
+        float flareY = sunBgY + (0 - sunBgY) * i * 0.2f;
+        float flareSize = 0.02f + (i % 3) * 0.01f;
+        float alpha = 0.15f / i;
+        glColor4f(1.0f, 0.7f + i * 0.05f, 0.3f, alpha);
+        drawCircle(flareX, flareY, flareSize, 15);
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+   
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    for (int i = 0; i < 12; i++) {
+        float angle = i * PI / 6 + sim.effectTime * 0.008f;
+        glBegin(GL_TRIANGLES);
+        glColor4f(1.0f, 0.9f, 0.5f, 0.35f);
+        glVertex2f(sunBgX + 0.06f * cos(angle - 0.04f), sunBgY + 0.06f * sin(angle - 0.04f));
+        glVertex2f(sunBgX + 0.06f * cos(angle + 0.04f), sunBgY + 0.06f * sin(angle + 0.04f));
+        glColor4f(1.0f, 0.7f, 0.2f, 0.0f);
+        glVertex2f(sunBgX + 0.22f * cos(angle), sunBgY + 0.22f * sin(angle));
+        glEnd();
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+   
+    const TransformGraph& g = frameTransforms;
+    float earthX = 0.0f, earthY = -0.1f;
+    float earthRadius = g.radius[earthViewNode];
+    bool legacyLighting = planetProgram == 0;
+
+    
+    if (surfaceTextures[2]) {
+        if (legacyLighting) drawAtmosphereShell(earthX, earthY, earthRadius);
+        drawSurface(2, earthX, earthY, earthRadius, sim.planetRotation[2] * 0.22f, 0.0f);
+        drawSurface(SURFACE_EARTH_CLOUDS, earthX, earthY, earthRadius, sim.cloudAngle * 1.3f, 0.0f);
+    } else {
+        drawEarthPolygons(earthX, earthY, earthRadius);
+    }
 
 
     glBlendFunc(GL_SRC_ALPHA, GL_ONE);
@@ -1099,7 +4368,10 @@ void drawFrame3() {
 
  
     float sunAngle = atan2(sunBgY - earthY, sunBgX - earthX) * 180.0f / PI;
-    drawDayNightMask(earthX, earthY, earthRadius * 0.99f, sunAngle);
+    // The close-up has the Sun in frame, so the shader's atmosphere rim stands in for the shell and
+    // the planet glow stays off.
+    if (legacyLighting) drawDayNightMask(earthX, earthY, earthRadius * 0.99f, sunAngle);
+    else drawLitDisc(2, earthX, earthY, earthRadius, sunAngle, 0.0f);
 
     
     glBlendFunc(GL_SRC_ALPHA, GL_ONE);
@@ -1111,7 +4383,7 @@ void drawFrame3() {
         float cityDist = earthRadius * (0.42f + (rand() % 40) / 100.0f);
         float cityX = cityDist * cos(cityAngle + i * 0.3f);
         float cityY = cityDist * sin(cityAngle + i * 0.3f);
-        float flicker = 0.9f + 0.1f * sin(angleAll * 0.15f + i * 2);
+        float flicker = 0.9f + 0.1f * sin(sim.effectTime * 0.15f + i * 2);
         glColor4f(1.0f, 0.9f, 0.6f, 0.08f * flicker);
         glPointSize(2.0f);
         glBegin(GL_POINTS);
@@ -1122,13 +4394,11 @@ void drawFrame3() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 
-    float issOrbitRadius = earthRadius * 1.15f;
-    float issAngle = angleAll * 0.05f;
-    float issX = earthX + issOrbitRadius * cos(issAngle * PI / 180.0f);
-    float issY = earthY + issOrbitRadius * sin(issAngle * PI / 180.0f);
+    float issX = earthX + g.worldX[issNode];
+    float issY = earthY + g.worldY[issNode];
 
     glColor4f(0.5f, 0.8f, 1.0f, 0.2f);
-    drawCircle(earthX, earthY, issOrbitRadius, 60, true);
+    drawCircle(earthX, earthY, g.orbit[issNode], 60, true);
 
     glColor3f(0.9f, 0.9f, 0.95f);
     glLineWidth(2.0f);
@@ -1151,11 +4421,9 @@ void drawFrame3() {
     glEnd();
 
 
-    for (int s = 0; s < 3; s++) {
-        float satOrbit = earthRadius * (1.25f + s * 0.08f);
-        float satAngle = angleAll * (0.03f + s * 0.01f) + s * PI * 2 / 3;
-        float satX = earthX + satOrbit * cos(satAngle);
-        float satY = earthY + satOrbit * sin(satAngle);
+    for (int n = satelliteNodes; n < satelliteNodes + 3; n++) {
+        float satX = earthX + g.worldX[n];
+        float satY = earthY + g.worldY[n];
         glColor4f(0.8f, 0.8f, 0.9f, 0.9f);
         glPointSize(3.0f);
         glBegin(GL_POINTS);
@@ -1164,81 +4432,393 @@ void drawFrame3() {
     }
 
 
-    float moonOrbitRadius = 0.5f;
-    float moonRad = moonAngle * PI / 180.0f;
-    float moonX = earthX + moonOrbitRadius * cos(moonRad);
-    float moonY = earthY + moonOrbitRadius * sin(moonRad);
-    float moonRadius = 0.08f;
-
-    glColor4f(0.4f, 0.45f, 0.55f, 0.25f);
-    drawCircle(earthX, earthY, moonOrbitRadius, 90, true);
+    float moonX = earthX + g.worldX[earthMoonNode];
+    float moonY = earthY + g.worldY[earthMoonNode];
+    float moonRadius = g.radius[earthMoonNode];
+
+    glColor4f(0.4f, 0.45f, 0.55f, 0.25f);
+    drawCircle(earthX, earthY, g.orbit[earthMoonNode], 90, true);
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    for (int i = 0; i < 6; i++) {
+        float ratio = (float)i / 6;
+        glColor4f(0.85f, 0.88f, 0.95f, (1.0f - ratio) * 0.1f);
+        drawCircle(moonX, moonY, moonRadius * (1.1f + ratio * 0.3f), 30);
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    if (surfaceTextures[SURFACE_MOON]) {
+        drawSurface(SURFACE_MOON, moonX, moonY, moonRadius, 0.0f, 0.0f);
+    } else {
+        glColor3f(0.88f, 0.88f, 0.92f);
+        drawCircle(moonX, moonY, moonRadius, 45);
+
+        glColor4f(0.5f, 0.52f, 0.55f, 0.5f);
+        drawEllipse(moonX - moonRadius * 0.25f, moonY + moonRadius * 0.15f, moonRadius * 0.22f, moonRadius * 0.18f, 12);
+        drawEllipse(moonX + moonRadius * 0.2f, moonY + moonRadius * 0.25f, moonRadius * 0.15f, moonRadius * 0.12f, 10);
+    }
+
+   
+    float moonSunAngle = atan2(sunBgY - moonY, sunBgX - moonX) * 180.0f / PI;
+    drawDayNightMask(moonX, moonY, moonRadius * 0.96f, moonSunAngle);
+
+    
+    glEnable(GL_BLEND);
+    glColor4f(0.3f, 0.5f, 0.8f, 0.15f);
+    glLineWidth(1.0f);
+    for (int i = 0; i < 5; i++) {
+        float offset = (i - 2) * 0.015f;
+        glBegin(GL_LINE_STRIP);
+        for (float t = 0; t <= 1.0f; t += 0.05f) {
+            float x = earthX * (1 - t) + moonX * t;
+            float y = earthY * (1 - t) + moonY * t + sin(t * PI * 3 + sim.effectTime * 0.1f) * 0.02f + offset;
+            glColor4f(0.3f, 0.5f, 0.8f, 0.1f * sin(t * PI));
+            glVertex2f(x, y);
+        }
+        glEnd();
+    }
+
+   
+    drawParticles(frameView->meteors);
+
+    drawHUD();
+}
+
+
+struct NightVertex {
+    float x, y, r, g, b, a;
+    float anim[4];
+};
+
+struct NightBatch {
+    GLenum mode;
+    bool additive;
+    int first, count;
+};
+
+const int NIGHT_STATIC = 0;
+const int NIGHT_STAR = 1;
+const int NIGHT_HALO = 2;
+const int NIGHT_AURORA = 3;
+const int NIGHT_FLAME = 4;
+const int NIGHT_SHIMMER = 5;
+
+const char* nightVertexShader =
+    "#version 110\n"
+    "uniform float time;\n"
+    "void main() {\n"
+    "    vec4 pos = gl_Vertex;\n"
+    "    vec4 color = gl_Color;\n"
+    "    vec4 a = gl_MultiTexCoord0;\n"
+    "    float size = 1.0;\n"
+    "    if (a.x > 0.5 && a.x < 2.5) {\n"
+    "        float twinkle = 0.6 + 0.4 * sin(time * a.y * 1.5 + a.z);\n"
+    "        if (a.x < 1.5) {\n"
+    "            color.rgb *= a.w * twinkle;\n"
+    "            size = 1.5 + a.w * twinkle * 2.0;\n"
+    "        } else {\n"
+    "            color.a *= twinkle;\n"
+    "        }\n"
+    "    } else if (a.x > 2.5 && a.x < 3.5) {\n"
+    "        float height = 0.3 + 0.2 * sin(time * 0.03 + a.y * 0.5 + a.z);\n"
+    "        float wave = sin(time * 0.05 + a.y * 0.3) * 0.05;\n"
+    "        pos.x += wave * sin(a.w * 6.2831853);\n"
+    "        pos.y += a.w * height;\n"
+    "        color.a = sin(a.w * 3.1415927) * (0.15 + 0.1 * sin(time * 0.04 + a.y));\n"
+    "    } else if (a.x > 3.5 && a.x < 4.5) {\n"
+    "        float phase = sin(time * 0.25 + a.y * 1.2);\n"
+    "        pos.x += phase * (0.003 + 0.005 * a.z);\n"
+    "        pos.y += a.z * (0.025 + 0.01 * sin(time * 0.3 + a.y));\n"
+    "    } else if (a.x > 4.5) {\n"
+    "        color.a *= 0.6 + 0.4 * sin(time * 0.2 + a.y);\n"
+    "        size = a.z;\n"
+    "    }\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * pos;\n"
+    "    gl_FrontColor = color;\n"
+    "    gl_PointSize = size;\n"
+    "}\n";
+
+const char* nightFragmentShader =
+    "#version 110\n"
+    "void main() {\n"
+    "    gl_FragColor = gl_Color;\n"
+    "}\n";
+
+vector<NightVertex> nightVertices;
+vector<NightBatch> nightBatches;
+vector<NightBatch> nightTierBatches[QUALITY_TIER_COUNT];
+unsigned int nightRandomState = 1;
+NightVertex nightPen = {0, 0, 1, 1, 1, 1, {0, 0, 0, 0}};
+GLuint nightProgram = 0, nightBuffer = 0;
+GLint nightTimeUniform = -1;
+
+void nightBatch(GLenum mode, bool additive) {
+    if (nightBatches.empty() || nightBatches.back().mode != mode || nightBatches.back().additive != additive) {
+        nightBatches.push_back({mode, additive, (int)nightVertices.size(), 0});
+    }
+}
+
+void nightColor(float r, float g, float b, float a = 1.0f) {
+    nightPen.r = r;
+    nightPen.g = g;
+    nightPen.b = b;
+    nightPen.a = a;
+}
+
+void nightAnim(float kind, float p0 = 0, float p1 = 0, float p2 = 0) {
+    nightPen.anim[0] = kind;
+    nightPen.anim[1] = p0;
+    nightPen.anim[2] = p1;
+    nightPen.anim[3] = p2;
+}
+
+void nightVertex(float x, float y) {
+    nightPen.x = x;
+    nightPen.y = y;
+    nightVertices.push_back(nightPen);
+    nightBatches.back().count++;
+}
+
+void nightPolygon(float ox, float oy, float scale, initializer_list<float> points) {
+    vector<float> p(points);
+    for (size_t i = 2; i + 3 < p.size(); i += 2) {
+        nightVertex(ox + p[0] * scale, oy + p[1] * scale);
+        nightVertex(ox + p[i] * scale, oy + p[i + 1] * scale);
+        nightVertex(ox + p[i + 2] * scale, oy + p[i + 3] * scale);
+    }
+}
+
+void nightCircle(float x, float y, float r, int segments) {
+    for (int i = 0; i < segments; i++) {
+        float t0 = 2.0f * PI * i / segments, t1 = 2.0f * PI * (i + 1) / segments;
+        nightVertex(x, y);
+        nightVertex(x + r * cos(t0), y + r * sin(t0));
+        nightVertex(x + r * cos(t1), y + r * sin(t1));
+    }
+}
+
+// The scene's random scatter comes from its own stream seeded by the session, so building it leaves
+// rand() where the legacy path expects it and every tier gets the same sky for a given seed.
+unsigned int nightRandom() {
+    nightRandomState ^= nightRandomState << 13;
+    nightRandomState ^= nightRandomState >> 17;
+    nightRandomState ^= nightRandomState << 5;
+    return nightRandomState;
+}
+
+void buildNightScene(int tier) {
+    nightBatches.clear();
+    nightRandomState = sessionSeed | 1;
+    nightAnim(NIGHT_STATIC);
+
+    nightBatch(GL_TRIANGLES, false);
+    const float sky[4][5] = {{-1.0f, 1.0f, 0.0f, 0.0f, 0.05f}, {1.0f, 1.0f, 0.0f, 0.0f, 0.05f},
+                             {1.0f, -0.3f, 0.02f, 0.02f, 0.08f}, {-1.0f, -0.3f, 0.02f, 0.02f, 0.08f}};
+    const int quad[6] = {0, 1, 2, 0, 2, 3};
+    for (int k : quad) {
+        nightColor(sky[k][2], sky[k][3], sky[k][4]);
+        nightVertex(sky[k][0], sky[k][1]);
+    }
+
+    nightBatch(GL_POINTS, true);
+    int milkyWayColumns = qualityTiers[tier].milkyWayColumns;
+    for (int i = 0; i < milkyWayColumns; i++) {
+        float t = (float)i / milkyWayColumns;
+        float x = -1.0f + t * 2.5f;
+        float baseY = 0.3f + 0.4f * sin(t * PI * 0.8f);
+        float spread = 0.15f + 0.1f * sin(t * PI * 2);
+        for (int j = 0; j < 8; j++) {
+            nightColor(0.6f + (nightRandom() % 20) / 100.0f, 0.55f + (nightRandom() % 20) / 100.0f, 0.7f + (nightRandom() % 20) / 100.0f,
+                       0.1f + 0.15f * (nightRandom() % 100) / 100.0f);
+            nightAnim(NIGHT_SHIMMER, (nightRandom() % 628) / 100.0f, 1.0f + (nightRandom() % 10) / 10.0f);
+            nightVertex(x + (nightRandom() % 20 - 10) / 100.0f, baseY + (nightRandom() % 100 - 50) / 100.0f * spread);
+        }
+    }
+
+    nightBatch(GL_POINTS, false);
+    for (auto& s : stars) {
+        float colorPhase = fmod(s.x * 50 + s.y * 30, 4.0f);
+        if (colorPhase < 1.0f) nightColor(0.7f, 0.8f, 1.0f);
+        else if (colorPhase < 2.0f) nightColor(1.0f, 1.0f, 1.0f);
+        else if (colorPhase < 3.0f) nightColor(1.0f, 0.95f, 0.7f);
+        else nightColor(1.0f, 0.8f, 0.6f);
+        nightAnim(NIGHT_STAR, s.twinkleSpeed, s.x * 15, s.brightness);
+        nightVertex(s.x, s.y);
+    }
+    nightBatch(GL_TRIANGLES, true);
+    for (auto& s : stars) {
+        if (s.brightness <= 0.8f) continue;
+        float colorPhase = fmod(s.x * 50 + s.y * 30, 4.0f);
+        if (colorPhase < 1.0f) nightColor(0.7f, 0.8f, 1.0f, 0.15f);
+        else if (colorPhase < 2.0f) nightColor(1.0f, 1.0f, 1.0f, 0.15f);
+        else if (colorPhase < 3.0f) nightColor(1.0f, 0.95f, 0.7f, 0.15f);
+        else nightColor(1.0f, 0.8f, 0.6f, 0.15f);
+        nightAnim(NIGHT_HALO, s.twinkleSpeed, s.x * 15);
+        nightCircle(s.x, s.y, 0.015f, 10);
+    }
+    nightAnim(NIGHT_STATIC);
+
+    float moonSkyX = 0.4f, moonSkyY = 0.55f;
+    for (int i = 0; i < 8; i++) {
+        float ratio = (float)i / 8;
+        nightColor(0.9f, 0.92f, 1.0f, (1.0f - ratio) * 0.08f);
+        nightCircle(moonSkyX, moonSkyY, 0.06f + ratio * 0.05f, 25);
+    }
+    nightBatch(GL_TRIANGLES, false);
+    nightColor(0.95f, 0.95f, 0.98f);
+    nightCircle(moonSkyX, moonSkyY, 0.05f, 35);
+    nightColor(0.01f, 0.01f, 0.04f);
+    nightCircle(moonSkyX + 0.025f, moonSkyY, 0.045f, 35);
+
+    nightBatch(GL_TRIANGLES, true);
+    int auroraStrips = qualityTiers[tier].auroraStrips / 3;
+    int auroraSteps = qualityTiers[tier].auroraSteps;
+    float auroraWidth = 0.02f * 20.0f / auroraStrips;
+    for (int layer = 0; layer < 3; layer++) {
+        for (int i = 0; i < auroraStrips; i++) {
+            float x = -0.9f + i * 1.8f / auroraStrips + layer * 0.02f;
+            float baseY = layer * 0.08f;
+            for (int h = 0; h < auroraSteps; h++) {
+                float ts[2] = {(float)h / auroraSteps, (float)(h + 1) / auroraSteps};
+                const int corners[6][2] = {{0, -1}, {0, 1}, {1, 1}, {0, -1}, {1, 1}, {1, -1}};
+                for (auto& c : corners) {
+                    float t = ts[c[0]];
+                    if (t < 0.5f) nightColor(0.2f, 0.9f + t * 0.1f, 0.4f + t * 0.3f);
+                    else nightColor(0.3f + (t - 0.5f) * 0.4f, 0.8f - (t - 0.5f) * 0.3f, 0.6f + (t - 0.5f) * 0.3f);
+                    nightAnim(NIGHT_AURORA, i, layer, t);
+                    nightVertex(x + c[1] * auroraWidth, baseY);
+                }
+            }
+        }
+    }
+    nightAnim(NIGHT_STATIC);
+
+    nightBatch(GL_TRIANGLES, false);
+    const float ground[4][5] = {{-1.0f, -0.3f, 0.02f, 0.02f, 0.03f}, {1.0f, -0.3f, 0.02f, 0.02f, 0.03f},
+                                {1.0f, -1.0f, 0.01f, 0.01f, 0.02f}, {-1.0f, -1.0f, 0.01f, 0.01f, 0.02f}};
+    for (int k : quad) {
+        nightColor(ground[k][2], ground[k][3], ground[k][4]);
+        nightVertex(ground[k][0], ground[k][1]);
+    }
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    for (int i = 0; i < 6; i++) {
-        float ratio = (float)i / 6;
-        glColor4f(0.85f, 0.88f, 0.95f, (1.0f - ratio) * 0.1f);
-        drawCircle(moonX, moonY, moonRadius * (1.1f + ratio * 0.3f), 30);
+    nightColor(0.03f, 0.03f, 0.04f);
+    const float ridge[11] = {-0.3f, -0.22f, -0.28f, -0.18f, -0.25f, -0.15f, -0.23f, -0.2f, -0.27f, -0.19f, -0.25f};
+    for (int i = 0; i < 10; i++) {
+        float x0 = -1.0f + i * 0.2f, x1 = x0 + 0.2f;
+        nightPolygon(0, 0, 1, {x0, -0.5f, x0, ridge[i], x1, ridge[i + 1], x1, -0.5f});
     }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glColor3f(0.88f, 0.88f, 0.92f);
-    drawCircle(moonX, moonY, moonRadius, 45);
+    nightColor(0.01f, 0.01f, 0.015f);
+    for (int i = 0; i < 25; i++) {
+        float tx = -0.95f + i * 0.08f;
+        float hillY = -0.25f + 0.08f * sin(tx * 2.5f + 0.5f);
+        float treeHeight = 0.04f + (i % 3) * 0.02f;
+        nightPolygon(tx, hillY, 1, {0.0f, 0.0f, -0.015f, -treeHeight, 0.015f, -treeHeight});
+    }
 
+    float humanX = -0.55f, groundY = -0.2f, scale = 3.6f, rimScale = scale * 1.06f;
+    nightColor(0.06f, 0.06f, 0.07f);
+    nightCircle(humanX + 0.02f * rimScale, groundY + 0.1f * rimScale, 0.025f * rimScale, 32);
+    nightPolygon(humanX, groundY, rimScale, {-0.025f, 0.06f, 0.03f, 0.065f, 0.1f, -0.03f, -0.09f, -0.02f});
+
+    nightBatch(GL_TRIANGLES, true);
+    nightColor(0.12f, 0.16f, 0.25f, 0.18f);
+    nightCircle(humanX + 0.02f * scale, groundY + 0.1f * scale, 0.055f * scale, 20);
+
+    nightBatch(GL_TRIANGLES, false);
+    nightColor(0.0f, 0.0f, 0.0f);
+    float headX = humanX + 0.02f * scale, headY = groundY + 0.1f * scale;
+    nightCircle(headX, headY, 0.025f * scale, 30);
+    nightPolygon(headX, headY, scale, {-0.028f, 0.008f, 0.018f, 0.022f, 0.025f, 0.01f, -0.022f, -0.002f});
+    nightPolygon(humanX, groundY, scale, {0.0f, 0.075f, 0.02f, 0.08f, 0.018f, 0.06f, -0.002f, 0.055f});
+    nightPolygon(humanX, groundY, scale, {-0.025f, 0.06f, 0.03f, 0.065f, 0.045f, 0.01f, 0.015f, -0.015f, -0.02f, 0.0f});
+    nightPolygon(humanX, groundY, scale, {-0.022f, 0.052f, -0.015f, 0.045f, -0.055f, 0.005f, -0.065f, 0.012f});
+    nightPolygon(humanX, groundY, scale, {-0.055f, 0.01f, -0.065f, 0.003f, -0.09f, -0.02f, -0.082f, -0.012f});
+    nightCircle(humanX - 0.09f * scale, groundY - 0.018f * scale, 0.015f * scale, 12);
+    nightPolygon(humanX, groundY, scale, {0.025f, 0.055f, 0.035f, 0.048f, 0.06f, 0.03f, 0.052f, 0.038f});
+    nightPolygon(humanX, groundY, scale, {0.055f, 0.035f, 0.065f, 0.028f, 0.08f, 0.012f, 0.072f, 0.02f});
+    nightCircle(humanX + 0.078f * scale, groundY + 0.015f * scale, 0.012f * scale, 10);
+    nightPolygon(humanX, groundY, scale, {-0.005f, 0.0f, 0.02f, -0.008f, 0.045f, 0.025f, 0.03f, 0.035f});
+    nightPolygon(humanX, groundY, scale, {0.035f, 0.03f, 0.05f, 0.022f, 0.065f, -0.025f, 0.05f, -0.02f});
+    nightPolygon(humanX, groundY, scale, {0.05f, -0.022f, 0.068f, -0.025f, 0.09f, -0.04f, 0.052f, -0.038f});
+    nightPolygon(humanX, groundY, scale, {0.025f, -0.01f, 0.045f, -0.018f, 0.1f, -0.03f, 0.095f, -0.02f});
+    nightPolygon(humanX, groundY, scale, {0.095f, -0.025f, 0.105f, -0.035f, 0.13f, -0.048f, 0.12f, -0.04f});
+    nightPolygon(humanX, groundY, scale, {0.12f, -0.042f, 0.135f, -0.048f, 0.155f, -0.065f, 0.12f, -0.058f});
+
+    float fireX = 0.55f, fireY = -0.35f;
+    nightBatch(GL_TRIANGLES, true);
+    for (int g = 0; g < 3; g++) {
+        nightColor(1.0f, 0.5f, 0.1f, 0.15f - g * 0.04f);
+        nightCircle(fireX, fireY + 0.01f, 0.03f + g * 0.02f, 20);
+    }
+    for (int f = 0; f < 4; f++) {
+        float fx = fireX + (f - 1.5f) * 0.008f;
+        nightColor(1.0f, 0.7f, 0.2f, 0.9f);
+        nightAnim(NIGHT_FLAME, f, 0);
+        nightVertex(fx - 0.006f, fireY);
+        nightVertex(fx + 0.006f, fireY);
+        nightColor(1.0f, 0.4f, 0.0f, 0.0f);
+        nightAnim(NIGHT_FLAME, f, 1);
+        nightVertex(fx, fireY);
+    }
+    nightAnim(NIGHT_STATIC);
+    nightTierBatches[tier].swap(nightBatches);
+}
 
-    glColor4f(0.5f, 0.52f, 0.55f, 0.5f);
-    drawEllipse(moonX - moonRadius * 0.25f, moonY + moonRadius * 0.15f, moonRadius * 0.22f, moonRadius * 0.18f, 12);
-    drawEllipse(moonX + moonRadius * 0.2f, moonY + moonRadius * 0.25f, moonRadius * 0.15f, moonRadius * 0.12f, 10);
+// Each quality tier gets its own batches in the shared vertex buffer, so the governor can trade
+// Milky Way and aurora detail on Frame 4 by switching batch lists instead of rebuilding geometry.
+void initNightScene() {
+    nightVertices.clear();
+    for (int tier = 0; tier < QUALITY_TIER_COUNT; tier++) buildNightScene(tier);
+    if (!useShaders || !hasShaders()) return;
+
+    nightProgram = buildProgram(nightVertexShader, nightFragmentShader, "Night scene");
+    if (!nightProgram) return;
+    nightTimeUniform = pglGetUniformLocation(nightProgram, "time");
+
+    if (pglGenBuffers && pglBindBuffer && pglBufferData) {
+        pglGenBuffers(1, &nightBuffer);
+        pglBindBuffer(GL_ARRAY_BUFFER, nightBuffer);
+        pglBufferData(GL_ARRAY_BUFFER, nightVertices.size() * sizeof(NightVertex), nightVertices.data(), GL_STATIC_DRAW);
+        pglBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
 
-   
-    float moonSunAngle = atan2(sunBgY - moonY, sunBgX - moonX) * 180.0f / PI;
-    drawDayNightMask(moonX, moonY, moonRadius * 0.96f, moonSunAngle);
+void drawNightScene() {
+    const char* base = nightBuffer ? nullptr : (const char*)nightVertices.data();
+    if (nightBuffer) pglBindBuffer(GL_ARRAY_BUFFER, nightBuffer);
+    pglUseProgram(nightProgram);
+    pglUniform1f(nightTimeUniform, sim.effectTime);
 
-    
     glEnable(GL_BLEND);
-    glColor4f(0.3f, 0.5f, 0.8f, 0.15f);
-    glLineWidth(1.0f);
-    for (int i = 0; i < 5; i++) {
-        float offset = (i - 2) * 0.015f;
-        glBegin(GL_LINE_STRIP);
-        for (float t = 0; t <= 1.0f; t += 0.05f) {
-            float x = earthX * (1 - t) + moonX * t;
-            float y = earthY * (1 - t) + moonY * t + sin(t * PI * 3 + angleAll * 0.1f) * 0.02f + offset;
-            glColor4f(0.3f, 0.5f, 0.8f, 0.1f * sin(t * PI));
-            glVertex2f(x, y);
-        }
-        glEnd();
-    }
-
-   
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    for (int m = 0; m < 5; m++) {
-        float meteorPhase = fmod(angleAll * 0.02f + m * 1.5f, 2.0f);
-        if (meteorPhase < 1.0f) {
-            float mx = 0.5f - m * 0.25f + meteorPhase * 0.3f;
-            float my = 0.9f - meteorPhase * 0.4f;
-            float meteorAlpha = sin(meteorPhase * PI);
-            
-            glColor4f(1.0f, 1.0f, 0.9f, meteorAlpha * 0.8f);
-            glPointSize(2.5f);
-            glBegin(GL_POINTS);
-            glVertex2f(mx, my);
-            glEnd();
-            
-            glBegin(GL_LINES);
-            glColor4f(1.0f, 0.8f, 0.5f, meteorAlpha * 0.6f);
-            glVertex2f(mx, my);
-            glColor4f(1.0f, 0.5f, 0.2f, 0.0f);
-            glVertex2f(mx - 0.05f, my + 0.03f);
-            glEnd();
-        }
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(NightVertex), base + offsetof(NightVertex, x));
+    glColorPointer(4, GL_FLOAT, sizeof(NightVertex), base + offsetof(NightVertex, r));
+    glTexCoordPointer(4, GL_FLOAT, sizeof(NightVertex), base + offsetof(NightVertex, anim));
+    for (const NightBatch& b : nightTierBatches[qualityTier]) {
+        glBlendFunc(GL_SRC_ALPHA, b.additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+        glDrawArrays(b.mode, b.first, b.count);
     }
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
 
-    drawHUD();
+    pglUseProgram(0);
+    if (nightBuffer) pglBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-
 void drawFrame4() {
+    if (nightProgram) {
+        drawNightScene();
+        drawHUD();
+        return;
+    }
+
    
     glBegin(GL_QUADS);
     glColor3f(0.0f, 0.0f, 0.05f);
@@ -1252,8 +4832,9 @@ void drawFrame4() {
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    for (int i = 0; i < 200; i++) {
-        float t = (float)i / 200;
+    int milkyWayColumns = qualityTiers[qualityTier].milkyWayColumns;
+    for (int i = 0; i < milkyWayColumns; i++) {
+        float t = (float)i / milkyWayColumns;
         float x = -1.0f + t * 2.5f;
         float baseY = 0.3f + 0.4f * sin(t * PI * 0.8f);
         float spread = 0.15f + 0.1f * sin(t * PI * 2);
@@ -1275,7 +4856,7 @@ void drawFrame4() {
 
     
     for (auto& s : stars) {
-        float twinkle = 0.6f + 0.4f * sin(angleAll * s.twinkleSpeed * 1.5f + s.x * 15);
+        float twinkle = 0.6f + 0.4f * sin(sim.effectTime * s.twinkleSpeed * 1.5f + s.x * 15);
         float brightness = s.brightness * twinkle;
         float colorPhase = fmod(s.x * 50 + s.y * 30, 4.0f);
         float r, g, b;
@@ -1316,18 +4897,21 @@ void drawFrame4() {
 
   
     glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    int auroraStrips = qualityTiers[qualityTier].auroraStrips / 3;
+    int auroraSteps = qualityTiers[qualityTier].auroraSteps;
+    float auroraWidth = 0.02f * 20.0f / auroraStrips;
     for (int layer = 0; layer < 3; layer++) {
-        for (int i = 0; i < 20; i++) {
-            float x = -0.9f + i * 0.09f + layer * 0.02f;
+        for (int i = 0; i < auroraStrips; i++) {
+            float x = -0.9f + i * 1.8f / auroraStrips + layer * 0.02f;
             float baseY = 0.0f + layer * 0.08f;
-            float height = 0.3f + 0.2f * sin(angleAll * 0.03f + i * 0.5f + layer);
-            float wave = sin(angleAll * 0.05f + i * 0.3f) * 0.05f;
+            float height = 0.3f + 0.2f * sin(sim.effectTime * 0.03f + i * 0.5f + layer);
+            float wave = sin(sim.effectTime * 0.05f + i * 0.3f) * 0.05f;
             
             glBegin(GL_QUAD_STRIP);
-            for (int h = 0; h <= 10; h++) {
-                float t = (float)h / 10;
+            for (int h = 0; h <= auroraSteps; h++) {
+                float t = (float)h / auroraSteps;
                 float y = baseY + t * height;
-                float alpha = sin(t * PI) * (0.15f + 0.1f * sin(angleAll * 0.04f + i));
+                float alpha = sin(t * PI) * (0.15f + 0.1f * sin(sim.effectTime * 0.04f + i));
                 float xOff = wave * sin(t * PI * 2);
                 
                 if (t < 0.5f) {
@@ -1336,8 +4920,8 @@ void drawFrame4() {
                     glColor4f(0.3f + (t - 0.5f) * 0.4f, 0.8f - (t - 0.5f) * 0.3f, 0.6f + (t - 0.5f) * 0.3f, alpha);
                 }
                 
-                glVertex2f(x + xOff - 0.02f, y);
-                glVertex2f(x + xOff + 0.02f, y);
+                glVertex2f(x + xOff - auroraWidth, y);
+                glVertex2f(x + xOff + auroraWidth, y);
             }
             glEnd();
         }
@@ -1514,189 +5098,1687 @@ void drawFrame4() {
     glVertex2f(humanX + 0.12f * scale, groundY - 0.058f * scale);
     glEnd();
 
-   
-    float fireX = 0.55f;
-    float fireY = -0.35f;
-    
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    for (int g = 0; g < 3; g++) {
-        float glowSize = 0.03f + g * 0.02f;
-        float glowAlpha = 0.15f - g * 0.04f;
-        glColor4f(1.0f, 0.5f, 0.1f, glowAlpha);
-        drawCircle(fireX, fireY + 0.01f, glowSize, 20);
+   
+    float fireX = 0.55f;
+    float fireY = -0.35f;
+    
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    for (int g = 0; g < 3; g++) {
+        float glowSize = 0.03f + g * 0.02f;
+        float glowAlpha = 0.15f - g * 0.04f;
+        glColor4f(1.0f, 0.5f, 0.1f, glowAlpha);
+        drawCircle(fireX, fireY + 0.01f, glowSize, 20);
+    }
+    
+    for (int f = 0; f < 4; f++) {
+        float flamePhase = sin(sim.effectTime * 0.25f + f * 1.2f);
+        float fx = fireX + (f - 1.5f) * 0.008f + flamePhase * 0.003f;
+        float flameHeight = 0.025f + 0.01f * sin(sim.effectTime * 0.3f + f);
+        
+        glBegin(GL_TRIANGLES);
+        glColor4f(1.0f, 0.7f, 0.2f, 0.9f);
+        glVertex2f(fx - 0.006f, fireY);
+        glVertex2f(fx + 0.006f, fireY);
+        glColor4f(1.0f, 0.4f, 0.0f, 0.0f);
+        glVertex2f(fx + flamePhase * 0.005f, fireY + flameHeight);
+        glEnd();
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    drawHUD();
+}
+
+float wrapRange(double v, float lo, float hi) {
+    double span = hi - lo;
+    v = fmod(v - lo, span);
+    if (v < 0) v += span;
+    return v + lo;
+}
+
+void advanceSimState(SimState& s, double dt, const bool* paused) {
+    s.time += dt;
+    s.angleAll = 0.5 * s.time;
+    s.effectTime = wrapPeriod(s.angleAll, EFFECT_PERIOD);
+    s.sunPulse = wrapPeriod(0.12 * s.time, TWO_PI);
+    s.coronaAngle = wrapPeriod(0.02 * s.time, TWO_PI);
+    s.heatwavePhase = wrapPeriod(0.08 * s.time, TWO_PI);
+    s.cloudAngle = wrapPeriod(0.3 * s.time, CLOUD_PERIOD);
+
+    for (int i = 0; i < 8; i++) {
+        if (!paused[i]) {
+            s.planetRotation[i] = wrapPeriod(s.planetRotation[i] + planetRotationSpeeds[i] * dt, ROTATION_PERIOD);
+        }
+        s.ringAngle[i] = wrapPeriod(0.2 * s.time, RING_PERIOD);
+    }
+
+    s.cometX = wrapRange(s.cometX + 0.004 * dt, -1.5f, 1.5f);
+    s.aircraftX = wrapRange(s.aircraftX + 0.005 * dt, -1.5f, 1.5f);
+    s.starScroll = wrapRange(s.starScroll - 0.0002 * dt, -2.0f, 0.0f);
+}
+
+void shiftWrappedParticles(ParticlePool& pool, float dt) {
+    float extent = pool.wrapExtent;
+    for (int i = 0; i < pool.count; i++) {
+        pool.x[i] = wrapRange(pool.x[i] + pool.vx[i] * dt, -extent, extent);
+        pool.y[i] = wrapRange(pool.y[i] + pool.vy[i] * dt, -extent, extent);
+    }
+}
+
+SimSnapshot& snapshotAt(int k) {
+    return snapshotRing[(snapshotHead + k) % SNAPSHOT_CAPACITY];
+}
+
+void recordSnapshot() {
+    if (snapshotRing.empty()) snapshotRing.resize(SNAPSHOT_CAPACITY);
+
+    SimSnapshot* snap;
+    if (snapshotCount > 0 && snapshotAt(snapshotCount - 1).state.tick == liveSim.tick) {
+        snap = &snapshotAt(snapshotCount - 1);
+    } else if (snapshotCount < SNAPSHOT_CAPACITY) {
+        snap = &snapshotAt(snapshotCount++);
+    } else {
+        snapshotHead = (snapshotHead + 1) % SNAPSHOT_CAPACITY;
+        snap = &snapshotAt(snapshotCount - 1);
+    }
+    snap->state = liveSim;
+    snap->speed = liveControls.speedMultiplier;
+    snap->warp = liveControls.timeWarp;
+    snap->paused = liveControls.isPaused;
+    for (int i = 0; i < 8; i++) snap->planetPaused[i] = liveControls.planetPaused[i];
+}
+
+void seekSimulation(long long targetTick) {
+    if (snapshotCount == 0) recordSnapshot();
+    targetTick = max(targetTick, snapshotAt(0).state.tick);
+
+    double previousTime = liveSim.time;
+    if (targetTick >= liveSim.tick) {
+        double dt = liveControls.isPaused ? 0.0 : (targetTick - liveSim.tick) * (double)liveControls.speedMultiplier * liveControls.timeWarp;
+        advanceSimState(liveSim, dt, liveControls.planetPaused);
+    } else {
+        int lo = 0, hi = snapshotCount - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (snapshotAt(mid).state.tick <= targetTick) lo = mid;
+            else hi = mid - 1;
+        }
+        const SimSnapshot& base = snapshotAt(lo);
+        snapshotCount = lo + 1;
+
+        liveSim = base.state;
+        advanceSimState(liveSim, base.paused ? 0.0 : (targetTick - base.state.tick) * (double)base.speed * base.warp, base.planetPaused);
+        liveControls.speedMultiplier = base.speed;
+        liveControls.timeWarp = liveControls.nbodyMode ? 1.0f : base.warp;
+        for (int i = 0; i < 8; i++) liveControls.planetPaused[i] = base.planetPaused[i];
+    }
+    liveSim.tick = targetTick;
+
+    shiftWrappedParticles(dustPool, liveSim.time - previousTime);
+    shootingStarPool.count = 0;
+    meteorPool.count = 0;
+    cometTailPool.count = 0;
+
+    breakTrailSamples();
+    recordSnapshot();
+}
+
+void cometPosition(float& x, float& y) {
+    if (liveControls.nbodyMode && !nbodyParticles.empty()) {
+        x = nbodyParticles[nbodyCometSlot].x;
+        y = nbodyParticles[nbodyCometSlot].y;
+    } else {
+        x = liveSim.cometX;
+        y = 0.75f + 0.05f * sin(liveSim.cometX * 3);
+    }
+}
+
+vector<Body> bodies;
+vector<int> pickHead;
+vector<int> bodyCell;
+vector<int> bodyNext;
+vector<int> bodyPrev;
+vector<int> largeBodies;
+const int PICK_GRID = 150;
+const float PICK_ORIGIN = -1.5f;
+const float PICK_CELL_SIZE = 0.02f;
+const float PICK_TOLERANCE = 0.012f;
+
+void setBody(int i, float x, float y, float radius, int kind, int index, int parent, bool visible) {
+    Body& b = bodies[i];
+    b.x = x;
+    b.y = y;
+    b.radius = radius;
+    b.kind = kind;
+    b.index = index;
+    b.parent = parent;
+    b.visible = visible;
+}
+
+void computeBodies() {
+    int moonTotal = 0;
+    for (int i = 0; i < 8; i++) moonTotal += moonCounts[i];
+    int rocks = asteroids.size();
+    int extra = liveControls.nbodyMode ? max(0, (int)nbodyParticles.size() - rocks - 1) : 0;
+    bodies.resize(1 + 8 + moonTotal + 3 + 1 + rocks + extra);
+
+    float sunRadius = 0.12f + 0.008f * sin(liveSim.sunPulse);
+    setBody(0, 0, 0, sunRadius, BODY_SUN, 0, -1, true);
+
+    const TransformGraph& g = liveTransforms;
+    updateTransforms(liveTransforms, liveSim.angleAll);
+    int next = 9;
+    for (int i = 0; i < 8; i++) {
+        int n = planetNodes[i];
+        bool visible = !liveControls.planetPaused[i];
+        setBody(1 + i, g.worldX[n], g.worldY[n], g.radius[n], BODY_PLANET, i, 0, visible);
+
+        for (int m = 0; m < moonCounts[i]; m++) {
+            n = moonNodes[i] + m;
+            setBody(next++, g.worldX[n], g.worldY[n], g.radius[n], BODY_MOON, m, 1 + i, visible);
+        }
+    }
+
+    setBody(next++, g.worldX[ceresNode], g.worldY[ceresNode], g.radius[ceresNode], BODY_DWARF, 0, 0, true);
+
+    int plutoBody = next;
+    setBody(next++, g.worldX[plutoNode], g.worldY[plutoNode], g.radius[plutoNode], BODY_DWARF, 1, 0, true);
+    setBody(next++, g.worldX[charonNode], g.worldY[charonNode], g.radius[charonNode], BODY_MOON, 0, plutoBody, true);
+
+    float cx, cy;
+    cometPosition(cx, cy);
+    setBody(next++, cx, cy, 0.012f, BODY_COMET, 0, 0, true);
+
+    int rockBase = next;
+    if (liveControls.nbodyMode) {
+        for (auto& p : nbodyParticles) {
+            if (p.id == 0) continue;
+            int index = rockBase + p.id - 1;
+            float radius = p.id <= rocks ? asteroids[p.id - 1].size : 0.001f;
+            setBody(index, p.x, p.y, radius, BODY_ASTEROID, p.id - 1, 0, true);
+        }
+    } else {
+        for (int i = 0; i < rocks; i++) {
+            const Asteroid& a = asteroids[i];
+            float rad = a.angle + wrapRadians(liveSim.angleAll * a.speed);
+            setBody(rockBase + i, a.distance * cos(rad), a.distance * sin(rad), a.size, BODY_ASTEROID, i, 0, true);
+        }
+    }
+}
+
+int pickCellOf(float x, float y) {
+    int cx = min(max((int)((x - PICK_ORIGIN) / PICK_CELL_SIZE), 0), PICK_GRID - 1);
+    int cy = min(max((int)((y - PICK_ORIGIN) / PICK_CELL_SIZE), 0), PICK_GRID - 1);
+    return cy * PICK_GRID + cx;
+}
+
+void updatePickGrid() {
+    if (pickHead.empty()) pickHead.assign(PICK_GRID * PICK_GRID, -1);
+    if (bodyCell.size() != bodies.size()) {
+        fill(pickHead.begin(), pickHead.end(), -1);
+        bodyCell.assign(bodies.size(), -1);
+        bodyNext.assign(bodies.size(), -1);
+        bodyPrev.assign(bodies.size(), -1);
+    }
+
+    largeBodies.clear();
+    for (int i = 0; i < (int)bodies.size(); i++) {
+        bool large = bodies[i].radius > PICK_CELL_SIZE;
+        if (large) largeBodies.push_back(i);
+        int cell = large ? -1 : pickCellOf(bodies[i].x, bodies[i].y);
+        int old = bodyCell[i];
+        if (cell == old) continue;
+        if (old >= 0) {
+            if (bodyPrev[i] >= 0) bodyNext[bodyPrev[i]] = bodyNext[i];
+            else pickHead[old] = bodyNext[i];
+            if (bodyNext[i] >= 0) bodyPrev[bodyNext[i]] = bodyPrev[i];
+        }
+        bodyCell[i] = cell;
+        if (cell < 0) continue;
+        bodyPrev[i] = -1;
+        bodyNext[i] = pickHead[cell];
+        if (pickHead[cell] >= 0) bodyPrev[pickHead[cell]] = i;
+        pickHead[cell] = i;
+    }
+}
+
+void considerPick(int i, float x, float y, int& best, float& bestDistance) {
+    const Body& b = bodies[i];
+    if (!b.visible) return;
+    float dx = b.x - x;
+    float dy = b.y - y;
+    float d = sqrt(dx * dx + dy * dy) - b.radius;
+    if (d < bestDistance) {
+        bestDistance = d;
+        best = i;
+    }
+}
+
+int pickBody(float x, float y) {
+    if (pickHead.empty()) return -1;
+    int best = -1;
+    float bestDistance = PICK_TOLERANCE;
+    for (int i : largeBodies) considerPick(i, x, y, best, bestDistance);
+
+    int reach = (int)ceil((PICK_CELL_SIZE + PICK_TOLERANCE) / PICK_CELL_SIZE);
+    int cell = pickCellOf(x, y);
+    int cx = cell % PICK_GRID, cy = cell / PICK_GRID;
+    for (int gy = max(cy - reach, 0); gy <= min(cy + reach, PICK_GRID - 1); gy++) {
+        for (int gx = max(cx - reach, 0); gx <= min(cx + reach, PICK_GRID - 1); gx++) {
+            for (int i = pickHead[gy * PICK_GRID + gx]; i >= 0; i = bodyNext[i]) considerPick(i, x, y, best, bestDistance);
+        }
+    }
+    return best;
+}
+
+void applyMouse(float x, float y) {
+    ControlState& c = liveControls;
+    if (c.multiView) {
+        c.multiView = false;
+        c.currentFrame = 1 + (x >= 0.0f) + 2 * (y < 0.0f);
+        return;
+    }
+    if (c.currentFrame == 2 && c.zoomPlanetIndex == -1) {
+        for (int i = 0; i < 8; i++) {
+            float px = -0.8f + (i % 4) * 0.4f;
+            float py = 0.5f - (i / 4) * 0.4f;
+            if ((x - px) * (x - px) + (y - py) * (y - py) < 0.15f * 0.15f) c.zoomPlanetIndex = i;
+        }
+        return;
+    }
+    if (c.currentFrame != 1) return;
+
+    c.selectedBody = pickBody(x, y);
+    if (c.selectedBody >= 0 && bodies[c.selectedBody].kind == BODY_PLANET) {
+        c.zoomPlanetIndex = bodies[c.selectedBody].index;
+        c.currentFrame = 2;
+    }
+}
+
+const chrono::steady_clock::time_point telemetryEpoch = chrono::steady_clock::now();
+double pendingUpdateStartUs = -1.0;
+float pendingUpdateMs = 0.0f;
+
+double telemetryClockUs() {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - telemetryEpoch).count();
+}
+
+// Trails are sampled on the simulation tick, every trailDecimation ticks of unpaused sim time, so
+// their spacing and length do not depend on how often the render thread consumes a frame. The ring
+// keeps enough samples to ride out a render stall of TRAIL_SAMPLE_HISTORY samples.
+void sampleTrails() {
+    int count = min((int)bodies.size(), trailBodyLimit);
+    if (count != trailSampleBodies) {
+        trailSampleBodies = count;
+        trailSampleRing.assign((size_t)TRAIL_SAMPLE_HISTORY * count * 2, 0.0f);
+        breakTrailSamples();
+    }
+    if (liveControls.isPaused || liveControls.timeWarp > 1.0f || liveSim.tick % trailDecimation != 0) return;
+    trailSampleSerial++;
+    float* sample = trailSampleRing.data() + (size_t)(trailSampleSerial % TRAIL_SAMPLE_HISTORY) * count * 2;
+    for (int i = 0; i < count; i++) {
+        sample[i * 2] = bodies[i].x;
+        sample[i * 2 + 1] = bodies[i].y;
+    }
+}
+
+void simulationTick() {
+    double startUs = telemetryClockUs();
+    liveSim.tick++;
+    if (!liveControls.isPaused) {
+        double previousAngle = liveSim.angleAll;
+        advanceSimState(liveSim, (double)liveControls.speedMultiplier * liveControls.timeWarp, liveControls.planetPaused);
+
+        if (liveControls.nbodyMode) stepNBody(previousAngle, liveSim.angleAll, liveControls.speedMultiplier);
+
+        float cometPosX, cometPosY;
+        cometPosition(cometPosX, cometPosY);
+        float sunDist = sqrt(cometPosX * cometPosX + cometPosY * cometPosY) + 1e-4f;
+        cometTailEmitter.x = cometPosX;
+        cometTailEmitter.y = cometPosY;
+        cometTailEmitter.vx = 0.004f * cometPosX / sunDist;
+        cometTailEmitter.vy = 0.004f * cometPosY / sunDist;
+
+        updateParticles(dustPool, liveControls.speedMultiplier);
+        updateParticles(shootingStarPool, liveControls.speedMultiplier);
+        updateParticles(meteorPool, liveControls.speedMultiplier);
+        updateParticles(cometTailPool, liveControls.speedMultiplier);
+        runEmitter(shootingStarEmitter, shootingStarPool, liveControls.speedMultiplier);
+        runEmitter(meteorEmitter, meteorPool, liveControls.speedMultiplier);
+        runEmitter(cometTailEmitter, cometTailPool, liveControls.speedMultiplier);
+    }
+    computeBodies();
+    updatePickGrid();
+    sampleTrails();
+    if (liveControls.eclipseMode && liveControls.timeWarp == 1.0f) updateEclipseSearch();
+    if (liveSim.tick % snapshotInterval == 0) recordSnapshot();
+
+    if (pendingUpdateStartUs < 0.0) pendingUpdateStartUs = startUs;
+    pendingUpdateMs += (telemetryClockUs() - startUs) / 1000.0;
+}
+
+void generateFrameState(FrameState& fs) {
+    fs.sim = liveSim;
+    fs.controls = liveControls;
+    fs.bodyCount = bodies.size();
+    fs.inputSequence = liveInputSequence;
+
+    // Hand over every trail sample the render thread has not consumed yet, oldest first.
+    int trailCount = trailSampleBodies;
+    long long firstSample = max(max(trailConsumedSerial.load(memory_order_acquire), trailSampleFloor),
+                                trailSampleSerial - TRAIL_SAMPLE_HISTORY) + 1;
+    int samples = (int)max(0LL, trailSampleSerial - firstSample + 1);
+    fs.trailPoints.reserve((size_t)TRAIL_SAMPLE_HISTORY * trailCount * 2);
+    fs.trailSerials.reserve(TRAIL_SAMPLE_HISTORY);
+    fs.trailPoints.resize((size_t)samples * trailCount * 2);
+    fs.trailSerials.resize(samples);
+    for (int s = 0; s < samples; s++) {
+        long long serial = firstSample + s;
+        const float* sample = trailSampleRing.data() + (size_t)(serial % TRAIL_SAMPLE_HISTORY) * trailCount * 2;
+        copy(sample, sample + trailCount * 2, fs.trailPoints.begin() + (size_t)s * trailCount * 2);
+        fs.trailSerials[s] = serial;
+    }
+    fs.trailClasses.resize(trailCount);
+    for (int i = 0; i < trailCount; i++) {
+        const Body& b = bodies[i];
+        unsigned char cls = TRAIL_HIDDEN;
+        if (b.visible && b.kind != BODY_SUN) cls = b.kind == BODY_PLANET ? b.index : 8 + min(b.kind - BODY_MOON, 3);
+        fs.trailClasses[i] = cls;
+    }
+    cometPosition(fs.cometX, fs.cometY);
+    if (liveControls.selectedBody >= 0 && liveControls.selectedBody < (int)bodies.size()) {
+        fs.selected = bodies[liveControls.selectedBody];
+    } else {
+        fs.controls.selectedBody = -1;
+    }
+
+    buildParticleBatch(dustPool, fs.dust);
+    buildParticleBatch(shootingStarPool, fs.shootingStars);
+    buildParticleBatch(meteorPool, fs.meteors);
+    buildParticleBatch(cometTailPool, fs.cometTail);
+
+    fs.eclipses.clear();
+    if (liveControls.eclipseMode) {
+        fs.eclipses.assign(eclipseEvents.begin(), eclipseEvents.begin() + min((int)eclipseEvents.size(), 6));
+    }
+
+    fs.nbodyPoints.clear();
+    fs.nbodyAsteroids.clear();
+    if (liveControls.nbodyMode) {
+        int rocks = asteroids.size();
+        fs.nbodyPoints.reserve(nbodyParticles.size() * 2);
+        for (auto& p : nbodyParticles) {
+            if (p.id > rocks) {
+                fs.nbodyPoints.push_back(p.x);
+                fs.nbodyPoints.push_back(p.y);
+            } else if (p.id > 0) {
+                fs.nbodyAsteroids.push_back(p.x);
+                fs.nbodyAsteroids.push_back(p.y);
+                fs.nbodyAsteroids.push_back(asteroids[p.id - 1].size);
+            }
+        }
+    }
+}
+
+void publishFrameState() {
+    FrameState& back = frameStates[frameWriteIndex];
+    double startUs = telemetryClockUs();
+    generateFrameState(back);
+    back.updateStartUs = pendingUpdateStartUs;
+    back.updateMs = pendingUpdateMs;
+    back.generateStartUs = startUs;
+    back.generateMs = (telemetryClockUs() - startUs) / 1000.0;
+    pendingUpdateStartUs = -1.0;
+    pendingUpdateMs = 0.0f;
+    frameWriteIndex = frameExchange.exchange(frameWriteIndex | 4, memory_order_acq_rel) & 3;
+}
+
+void consumeFrameState() {
+    if (frameExchange.load(memory_order_acquire) & 4) {
+        frameReadIndex = frameExchange.exchange(frameReadIndex, memory_order_acq_rel) & 3;
+    }
+    frameView = &frameStates[frameReadIndex];
+
+    const ControlState& c = frameView->controls;
+    sim = frameView->sim;
+    currentFrame = c.currentFrame;
+    zoomPlanetIndex = c.zoomPlanetIndex;
+    selectedBody = c.selectedBody;
+    isPaused = c.isPaused;
+    showHelp = c.showHelp;
+    eclipseMode = c.eclipseMode;
+    nbodyMode = c.nbodyMode;
+    speedMultiplier = c.speedMultiplier;
+    timeWarp = c.timeWarp;
+    multiView = c.multiView;
+    showTrails = c.showTrails;
+    for (int i = 0; i < 8; i++) planetPaused[i] = c.planetPaused[i];
+    updateTransforms(frameTransforms, sim.angleAll);
+
+    recordTrails();
+}
+
+int latencyKind(int type, int key) {
+    if (type == INPUT_MOUSE) return LATENCY_MOUSE;
+    if (type == INPUT_KEY && key >= '1' && key <= '4') return LATENCY_FRAME_SWITCH;
+    if (type == INPUT_KEY && (key == 'p' || key == 'P')) return LATENCY_PAUSE;
+    return LATENCY_KEY;
+}
+
+bool pushInput(int type, int key, float x, float y) {
+    unsigned int head = inputHead.load(memory_order_relaxed);
+    if (head - inputTail.load(memory_order_acquire) >= INPUT_QUEUE_SIZE) return false;
+    if (pendingHead - pendingTail >= INPUT_QUEUE_SIZE) pendingTail++;
+    unsigned int sequence = ++inputSequence;
+    pendingInputs[pendingHead++ % INPUT_QUEUE_SIZE] = {sequence, latencyKind(type, key), telemetryClockUs()};
+    inputQueue[head % INPUT_QUEUE_SIZE] = {type, key, x, y, sequence};
+    inputHead.store(head + 1, memory_order_release);
+    return true;
+}
+
+void addLatencySample(LatencyStats& stats, float ms) {
+    stats.samples[stats.head] = ms;
+    stats.head = (stats.head + 1) % LATENCY_HISTORY;
+    stats.count = min(stats.count + 1, LATENCY_HISTORY);
+    stats.total++;
+
+    float sorted[LATENCY_HISTORY];
+    copy(stats.samples, stats.samples + stats.count, sorted);
+    sort(sorted, sorted + stats.count);
+    stats.p50 = sorted[(stats.count - 1) * 50 / 100];
+    stats.p95 = sorted[(stats.count - 1) * 95 / 100];
+    stats.p99 = sorted[(stats.count - 1) * 99 / 100];
+}
+
+void recordInputLatency(double presentUs) {
+    frameInputCount = 0;
+    while (pendingTail != pendingHead) {
+        const PendingInput& p = pendingInputs[pendingTail % INPUT_QUEUE_SIZE];
+        if (p.sequence > frameView->inputSequence) break;
+        LatencyStats& stats = latencyStats[p.kind];
+        float ms = (presentUs - p.startUs) / 1000.0;
+        addLatencySample(stats, ms);
+        if (frameInputCount < LATENCY_PER_FRAME) {
+            frameInputs[frameInputCount++] = {p.kind, p.startUs, ms, stats.p50, stats.p95, stats.p99};
+        }
+        pendingTail++;
+    }
+}
+
+bool popInput(InputEvent& ev) {
+    unsigned int tail = inputTail.load(memory_order_relaxed);
+    if (tail == inputHead.load(memory_order_acquire)) return false;
+    ev = inputQueue[tail % INPUT_QUEUE_SIZE];
+    inputTail.store(tail + 1, memory_order_release);
+    return true;
+}
+
+void applyKey(unsigned char key) {
+    ControlState& c = liveControls;
+    if (key >= '1' && key <= '4') {
+        c.currentFrame = key - '0';
+        return;
+    }
+
+    switch (key) {
+        case 'p': case 'P': c.isPaused = !c.isPaused; recordSnapshot(); break;
+        case 'h': case 'H': c.showHelp = !c.showHelp; break;
+        case '+': case '=': 
+            c.speedMultiplier = min(c.speedMultiplier + 0.25f, 2.0f); 
+            recordSnapshot();
+            break;
+        case '-': case '_': 
+            c.speedMultiplier = max(c.speedMultiplier - 0.25f, 0.25f); 
+            recordSnapshot();
+            break;
+        case 'e': case 'E': c.eclipseMode = !c.eclipseMode; break;
+        case 'n': case 'N':
+            c.nbodyMode = !c.nbodyMode;
+            if (c.nbodyMode) {
+                c.timeWarp = 1.0f;
+                recordSnapshot();
+                initializeNBody();
+            }
+            break;
+        case '.': case '>':
+            if (!c.nbodyMode) c.timeWarp = min(c.timeWarp * 10.0f, MAX_TIME_WARP);
+            recordSnapshot();
+            break;
+        case ',': case '<':
+            c.timeWarp = max(c.timeWarp / 10.0f, 1.0f);
+            recordSnapshot();
+            break;
+        case 'i': case 'I': c.nbodyLeapfrog = !c.nbodyLeapfrog; break;
+        case 'z': case 'Z': c.zoomPlanetIndex = -1; c.selectedBody = -1; break;
+        case 't': case 'T': c.showTrails = !c.showTrails; break;
+        case 'm': case 'M': c.multiView = !c.multiView; break;
+        case 'v': case 'V': c.paceCycles++; break;
+        case 'q': case 'Q': c.qualityCycles++; break;
+        case '0': case '5': case '6': case '7':
+            c.planetPaused[key - '0'] = !c.planetPaused[key - '0'];
+            recordSnapshot();
+            break;
+        case '[': seekSimulation(liveSim.tick - 300); break;
+        case ']': seekSimulation(liveSim.tick + 300); break;
+    }
+}
+
+void applySpecialKey(int key) {
+    if (liveControls.currentFrame == 2 && liveControls.zoomPlanetIndex == -1) {
+        if (key >= GLUT_KEY_F1 && key <= GLUT_KEY_F8) {
+            liveControls.zoomPlanetIndex = key - GLUT_KEY_F1;
+        }
+    }
+}
+
+unsigned long long simChecksum() {
+    unsigned long long hash = 1469598103934665603ULL;
+    auto mix = [&](const void* data, size_t bytes) {
+        const unsigned char* b = (const unsigned char*)data;
+        for (size_t i = 0; i < bytes; i++) hash = (hash ^ b[i]) * 1099511628211ULL;
+    };
+    mix(&liveSim.tick, sizeof(liveSim.tick));
+    mix(&liveSim.time, (const char*)(&liveSim.starScroll + 1) - (const char*)&liveSim.time);
+    mix(&liveControls.speedMultiplier, sizeof(float));
+    const ParticlePool* pools[] = {&dustPool, &shootingStarPool, &meteorPool, &cometTailPool};
+    for (const ParticlePool* pool : pools) {
+        mix(&pool->count, sizeof(int));
+        mix(pool->x.data(), pool->count * sizeof(float));
+        mix(pool->y.data(), pool->count * sizeof(float));
+    }
+    if (liveControls.nbodyMode) mix(nbodyParticles.data(), nbodyParticles.size() * sizeof(NBodyParticle));
+    return hash;
+}
+
+void applyInput(const InputEvent& ev) {
+    if (recordFile) {
+        fprintf(recordFile, "%lld %d %d %.9g %.9g\n", liveSim.tick, ev.type, ev.key, ev.x, ev.y);
+    }
+    if (ev.type == INPUT_KEY) applyKey((unsigned char)ev.key);
+    else if (ev.type == INPUT_SPECIAL) applySpecialKey(ev.key);
+    else if (ev.type == INPUT_MOUSE) applyMouse(ev.x, ev.y);
+}
+
+void processInputs() {
+    InputEvent ev;
+    while (popInput(ev)) {
+        if (replaying) continue;
+        applyInput(ev);
+        liveInputSequence = ev.sequence;
+    }
+    if (!replaying) return;
+
+    while (replayNext < replayEvents.size() && replayEvents[replayNext].tick <= liveSim.tick) {
+        applyInput(replayEvents[replayNext++].event);
+    }
+    if (replayNext == replayEvents.size() && liveSim.tick >= replayEndTick && !replayFinished.load()) {
+        replayChecksum = simChecksum();
+        replayFinished = true;
+    }
+}
+
+void simulationLoop() {
+    auto next = chrono::steady_clock::now();
+    while (simRunning.load()) {
+        processInputs();
+        simulationTick();
+        publishFrameState();
+
+        next += SIM_PERIOD;
+        auto now = chrono::steady_clock::now();
+        if (now - next > SIM_PERIOD * 15) next = now;
+        this_thread::sleep_until(next);
+    }
+}
+
+void startSimulationThread() {
+    simRunning = true;
+    simThread = thread(simulationLoop);
+}
+
+void stopSimulationThread() {
+    if (!simRunning.exchange(false)) return;
+    simThread.join();
+}
+
+void catchUpSimulation() {
+    auto now = chrono::steady_clock::now();
+    if (now - paceLastSimStep > SIM_PERIOD * 15) paceLastSimStep = now - SIM_PERIOD;
+    bool stepped = false;
+    while (now - paceLastSimStep >= SIM_PERIOD) {
+        processInputs();
+        simulationTick();
+        paceLastSimStep += SIM_PERIOD;
+        stepped = true;
+    }
+    if (stepped) publishFrameState();
+}
+
+void resetPaceStats() {
+    paceIntervalHead = paceIntervalCount = 0;
+    paceMeanMs = paceJitterMs = paceWorstMs = 0.0f;
+    pacePresented = paceMissed = 0;
+}
+
+float recordPresent() {
+    auto now = chrono::steady_clock::now();
+    float ms = 0.0f;
+    if (pacePresented++ > 0) {
+        ms = chrono::duration<float, milli>(now - paceLastPresent).count();
+        paceIntervals[paceIntervalHead] = ms;
+        paceIntervalHead = (paceIntervalHead + 1) % PACE_HISTORY;
+        paceIntervalCount = min(paceIntervalCount + 1, PACE_HISTORY);
+        if (paceMode == PACE_TARGET && ms > 1500.0f / paceTargetHz) paceMissed++;
+
+        float sum = 0.0f, sumSq = 0.0f, worst = 0.0f;
+        for (int i = 0; i < paceIntervalCount; i++) {
+            sum += paceIntervals[i];
+            sumSq += paceIntervals[i] * paceIntervals[i];
+            worst = max(worst, paceIntervals[i]);
+        }
+        paceMeanMs = sum / paceIntervalCount;
+        paceJitterMs = sqrt(max(sumSq / paceIntervalCount - paceMeanMs * paceMeanMs, 0.0f));
+        paceWorstMs = worst;
     }
-    
-    for (int f = 0; f < 4; f++) {
-        float flamePhase = sin(angleAll * 0.25f + f * 1.2f);
-        float fx = fireX + (f - 1.5f) * 0.008f + flamePhase * 0.003f;
-        float flameHeight = 0.025f + 0.01f * sin(angleAll * 0.3f + f);
-        
-        glBegin(GL_TRIANGLES);
-        glColor4f(1.0f, 0.7f, 0.2f, 0.9f);
-        glVertex2f(fx - 0.006f, fireY);
-        glVertex2f(fx + 0.006f, fireY);
-        glColor4f(1.0f, 0.4f, 0.0f, 0.0f);
-        glVertex2f(fx + flamePhase * 0.005f, fireY + flameHeight);
-        glEnd();
+    paceLastPresent = now;
+    return ms;
+}
+
+void setPaceMode(int mode) {
+    if (mode == PACE_VSYNC && !pSwapInterval) {
+        cerr << "Swap interval control unavailable, pacing to " << paceTargetHz << " Hz instead of vsync" << endl;
+        mode = PACE_TARGET;
     }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    paceMode = mode;
+    if (pSwapInterval) pSwapInterval(mode == PACE_VSYNC ? 1 : 0);
+    paceDeadline = chrono::steady_clock::now();
+    resetPaceStats();
+}
 
-    drawHUD();
+void cyclePaceMode() {
+    int mode = (paceMode + 1) % 3;
+    if (mode == PACE_VSYNC && !pSwapInterval) mode = PACE_TARGET;
+    setPaceMode(mode);
 }
 
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT);
+void applyQualityTier(int tier) {
+    qualityTier = tier;
+    qualityOverBudget = qualityUnderBudget = 0;
+    qualityCooldown = 30;
+    if (qualityTiers[tier].smoothing) {
+        glEnable(GL_POINT_SMOOTH);
+        glEnable(GL_LINE_SMOOTH);
+        glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
+        glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+    } else {
+        glDisable(GL_POINT_SMOOTH);
+        glDisable(GL_LINE_SMOOTH);
+        glHint(GL_POINT_SMOOTH_HINT, GL_FASTEST);
+        glHint(GL_LINE_SMOOTH_HINT, GL_FASTEST);
+    }
+}
+
+void cycleQualityMode() {
+    if (qualityAuto) {
+        qualityAuto = false;
+        applyQualityTier(QUALITY_TIER_COUNT - 1);
+    } else if (qualityTier > 0) {
+        applyQualityTier(qualityTier - 1);
+    } else {
+        qualityAuto = true;
+        qualityFrameMs = 0.0f;
+        applyQualityTier(QUALITY_TIER_COUNT - 1);
+    }
+}
+
+// The deadline a frame has to meet under the active pacing mode, or 0 when there is none. Under vsync
+// the shortest recent present interval is the refresh period, since longer ones are missed refreshes;
+// an uncapped loop has no deadline unless --quality-budget sets one.
+float frameBudgetMs() {
+    if (qualityBudgetMs > 0.0f) return qualityBudgetMs;
+    if (paceMode == PACE_TARGET) return 1000.0f / paceTargetHz;
+    if (paceMode == PACE_UNCAPPED || paceIntervalCount < 30) return 0.0f;
+    return *min_element(paceIntervals, paceIntervals + paceIntervalCount);
+}
+
+void updateQualityGovernor(float workMs) {
+    if (!qualityAuto) return;
+    qualityFrameMs = qualityFrameMs == 0.0f ? workMs : qualityFrameMs * 0.9f + workMs * 0.1f;
+    if (qualityCooldown > 0) {
+        qualityCooldown--;
+        return;
+    }
+
+    float budget = frameBudgetMs();
+    if (budget <= 0.0f) return;
+    qualityOverBudget = qualityFrameMs > budget * 0.85f ? qualityOverBudget + 1 : 0;
+    qualityUnderBudget = qualityFrameMs < budget * 0.45f ? qualityUnderBudget + 1 : 0;
+    if (qualityOverBudget >= 20 && qualityTier > 0) {
+        applyQualityTier(qualityTier - 1);
+    } else if (qualityUnderBudget >= 180 && qualityTier < QUALITY_TIER_COUNT - 1) {
+        applyQualityTier(qualityTier + 1);
+    }
+}
+
+// Pace and quality modes belong to the render thread, so their keys travel through the input queue
+// as press counts in the control state and are applied here once the frame carrying them arrives.
+void applyViewControls() {
+    const ControlState& c = frameView->controls;
+    for (; paceCyclesApplied < c.paceCycles; paceCyclesApplied++) cyclePaceMode();
+    for (; qualityCyclesApplied < c.qualityCycles; qualityCyclesApplied++) cycleQualityMode();
+}
+
+void setProjection(int width, int height) {
+    glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
+    float aspect = (float)width / (float)height;
+    if (width >= height) {
+        glOrtho(-aspect, aspect, -1.0, 1.0, -1.0, 1.0);
+        viewHalfWidth = aspect;
+        viewHalfHeight = 1.0f;
+    } else {
+        glOrtho(-1.0, 1.0, -1.0/aspect, 1.0/aspect, -1.0, 1.0);
+        viewHalfWidth = 1.0f;
+        viewHalfHeight = 1.0f / aspect;
+    }
+    glMatrixMode(GL_MODELVIEW);
+}
 
-    switch (currentFrame) {
+void drawScene(int scene) {
+    switch (scene) {
         case 1: drawFrame1(); break;
         case 2: drawFrame2(); break;
         case 3: drawFrame3(); break;
         case 4: drawFrame4(); break;
         default: drawFrame1(); break;
     }
+}
+
+void renderMultiView() {
+    int tileWidth = max(1, windowWidth / 2), tileHeight = max(1, windowHeight / 2);
+    int liveFrame = currentFrame, liveTier = qualityTier;
+    float tileBudgetMs = frameBudgetMs() / 4.0f;
+
+    qualityTier = max(0, qualityTier - 1);
+    drawingTile = true;
+    glEnable(GL_SCISSOR_TEST);
+    for (int t = 0; t < 4; t++) {
+        int tx = (t % 2) * tileWidth, ty = (1 - t / 2) * tileHeight;
+        tileStartUs[t] = telemetryClockUs();
+        glViewport(tx, ty, tileWidth, tileHeight);
+        glScissor(tx, ty, tileWidth, tileHeight);
+        setProjection(tileWidth, tileHeight);
+        glLoadIdentity();
+        currentFrame = t + 1;
+        drawScene(currentFrame);
+
+        tileMs[t] = (telemetryClockUs() - tileStartUs[t]) / 1000.0;
+        tileAverageMs[t] += (tileMs[t] - tileAverageMs[t]) * 0.1f;
+        const char* label = !showPacingStats ? arenaPrintf("FRAME %d", t + 1)
+                            : tileBudgetMs > 0.0f ? arenaPrintf("FRAME %d  %.2f / %.2f MS", t + 1, tileAverageMs[t], tileBudgetMs)
+                                                  : arenaPrintf("FRAME %d  %.2f MS", t + 1, tileAverageMs[t]);
+        if (showPacingStats && tileBudgetMs > 0.0f && tileAverageMs[t] > tileBudgetMs) glColor4f(1.0f, 0.4f, 0.3f, 0.9f);
+        else glColor4f(0.6f, 0.8f, 0.9f, 0.9f);
+        drawText(label, -viewHalfWidth + 0.04f, viewHalfHeight - 0.1f);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    drawingTile = false;
+    currentFrame = liveFrame;
+    qualityTier = liveTier;
+
+    glViewport(0, 0, windowWidth, windowHeight);
+    setProjection(windowWidth, windowHeight);
+    glLoadIdentity();
+    glColor4f(0.2f, 0.3f, 0.4f, 0.8f);
+    glBegin(GL_LINES);
+    glVertex2f(0.0f, -viewHalfHeight);
+    glVertex2f(0.0f, viewHalfHeight);
+    glVertex2f(-viewHalfWidth, 0.0f);
+    glVertex2f(viewHalfWidth, 0.0f);
+    glEnd();
+    drawHUD();
+}
+
+void renderScene() {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glLoadIdentity();
+
+    if (multiView) renderMultiView();
+    else drawScene(currentFrame);
 
     drawHelpOverlay();
-    glutSwapBuffers();
 }
 
-void update(int value) {
-    if (!isPaused) {
-        angleAll += 0.5f * speedMultiplier;
-        moonAngle += 2.0f * speedMultiplier;
-        sunPulse += 0.12f * speedMultiplier;
-        coronaAngle += 0.02f * speedMultiplier;
-        heatwavePhase += 0.08f * speedMultiplier;
-        cloudAngle += 0.3f * speedMultiplier;
-        ceresAngle += 0.004f * speedMultiplier;
+struct TelemetryRecord {
+    long long frame, tick;
+    int scene, bodies, particles;
+    float speed, simTime;
+    double updateStartUs, generateStartUs, submitStartUs, swapStartUs, presentUs;
+    float updateMs, generateMs, submitMs, swapMs, presentMs;
+    bool multiView;
+    double tileStartUs[4];
+    float tileMs[4], tileBudgetMs;
+    int inputCount;
+    InputLatency inputs[LATENCY_PER_FRAME];
+};
 
-        for (int i = 0; i < 8; i++) {
-            if (!planetPaused[i]) {
-                planetRotation[i] += planetRotationSpeeds[i] * speedMultiplier;
-            }
-            ringAngle[i] += 0.2f * speedMultiplier;
+const int TELEMETRY_QUEUE_SIZE = 4096;
+
+string telemetryPath;
+bool telemetryCSV = false;
+FILE* telemetryFile = nullptr;
+TelemetryRecord telemetryQueue[TELEMETRY_QUEUE_SIZE];
+atomic<unsigned int> telemetryHead(0), telemetryTail(0);
+atomic<bool> telemetryRunning(false);
+thread telemetryWriter;
+long long telemetryFrames = 0, telemetryDropped = 0, telemetryLastTick = -1;
+
+void writeTelemetryRecord(const TelemetryRecord& r) {
+    if (telemetryCSV) {
+        float inputMs = 0.0f;
+        for (int i = 0; i < r.inputCount; i++) inputMs = max(inputMs, r.inputs[i].ms);
+        fprintf(telemetryFile, "%lld,%.1f,%d,%.2f,%lld,%.3f,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%.3f\n",
+                r.frame, r.presentUs, r.scene, r.speed, r.tick, r.simTime, r.bodies, r.particles,
+                r.updateMs, r.generateMs, r.submitMs, r.swapMs, r.presentMs,
+                r.tileMs[0], r.tileMs[1], r.tileMs[2], r.tileMs[3], r.inputCount, inputMs);
+        return;
+    }
+    if (r.updateStartUs >= 0.0) {
+        fprintf(telemetryFile, "{\"name\":\"update\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"tick\":%lld}},\n",
+                r.updateStartUs, r.updateMs * 1000.0f, r.tick);
+        fprintf(telemetryFile, "{\"name\":\"generate\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"tick\":%lld}},\n",
+                r.generateStartUs, r.generateMs * 1000.0f, r.tick);
+    }
+    fprintf(telemetryFile, "{\"name\":\"submit\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"frame\":%lld,\"scene\":%d}},\n",
+            r.submitStartUs, r.submitMs * 1000.0f, r.frame, r.scene);
+    if (r.multiView) {
+        for (int t = 0; t < 4; t++) {
+            fprintf(telemetryFile, "{\"name\":\"tile %d\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"frame\":%lld,\"budget_ms\":%.3f}},\n",
+                    t + 1, r.tileStartUs[t], r.tileMs[t] * 1000.0f, r.frame, r.tileBudgetMs);
+        }
+    }
+    fprintf(telemetryFile, "{\"name\":\"swap\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"frame\":%lld}},\n",
+            r.swapStartUs, r.swapMs * 1000.0f, r.frame);
+    fprintf(telemetryFile, "{\"name\":\"frame\",\"ph\":\"C\",\"pid\":1,\"ts\":%.1f,\"args\":{\"present_ms\":%.3f,\"speed\":%.2f,\"scene\":%d}},\n",
+            r.presentUs, r.presentMs, r.speed, r.scene);
+    fprintf(telemetryFile, "{\"name\":\"objects\",\"ph\":\"C\",\"pid\":1,\"ts\":%.1f,\"args\":{\"bodies\":%d,\"particles\":%d}},\n",
+            r.presentUs, r.bodies, r.particles);
+    for (int i = 0; i < r.inputCount; i++) {
+        const InputLatency& in = r.inputs[i];
+        fprintf(telemetryFile, "{\"name\":\"input %s\",\"ph\":\"X\",\"pid\":1,\"tid\":3,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"frame\":%lld}},\n",
+                latencyNames[in.kind], in.startUs, in.ms * 1000.0f, r.frame);
+        fprintf(telemetryFile, "{\"name\":\"input latency %s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.1f,\"args\":{\"p50_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f}},\n",
+                latencyNames[in.kind], r.presentUs, in.p50, in.p95, in.p99);
+    }
+}
+
+void telemetryWriterLoop() {
+    while (true) {
+        bool running = telemetryRunning.load();
+        unsigned int tail = telemetryTail.load(memory_order_relaxed);
+        unsigned int head = telemetryHead.load(memory_order_acquire);
+        while (tail != head) {
+            writeTelemetryRecord(telemetryQueue[tail % TELEMETRY_QUEUE_SIZE]);
+            telemetryTail.store(++tail, memory_order_release);
         }
+        if (!running) break;
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
 
-        cometX += 0.004f * speedMultiplier;
-        if (cometX > 1.5f) cometX = -1.5f;
+void startTelemetry() {
+    telemetryFile = fopen(telemetryPath.c_str(), "w");
+    if (!telemetryFile) {
+        cerr << "Cannot open telemetry file " << telemetryPath << endl;
+        exit(1);
+    }
+    if (telemetryCSV) {
+        fprintf(telemetryFile, "frame,timestamp_us,scene,speed,tick,sim_time,bodies,particles,"
+                               "update_ms,generate_ms,submit_ms,swap_ms,present_ms,"
+                               "tile1_ms,tile2_ms,tile3_ms,tile4_ms,inputs,input_latency_ms\n");
+    } else {
+        fprintf(telemetryFile, "[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"render\"}},\n");
+        fprintf(telemetryFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"simulation\"}},\n");
+        fprintf(telemetryFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"input\"}},\n");
+    }
+    telemetryRunning = true;
+    telemetryWriter = thread(telemetryWriterLoop);
+}
 
-        aircraftX += 0.005f * speedMultiplier;
-        if (aircraftX > 1.5f) aircraftX = -1.5f;
+void stopTelemetry() {
+    if (!telemetryRunning.exchange(false)) return;
+    telemetryWriter.join();
+    if (!telemetryCSV) {
+        fprintf(telemetryFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Solar System Explorer\"}}\n]\n");
+    }
+    fclose(telemetryFile);
+    cerr << "Telemetry: " << telemetryFrames << " frames written to " << telemetryPath;
+    if (telemetryDropped > 0) cerr << ", " << telemetryDropped << " dropped (writer fell behind)";
+    cerr << endl;
+}
 
-        starScroll -= 0.0002f * speedMultiplier;
-        if (starScroll < -2.0f) starScroll = 0;
+void recordTelemetry(double submitStartUs, double swapStartUs, double presentUs, float presentMs) {
+    if (!telemetryRunning.load(memory_order_relaxed)) return;
+    unsigned int head = telemetryHead.load(memory_order_relaxed);
+    if (head - telemetryTail.load(memory_order_acquire) >= TELEMETRY_QUEUE_SIZE) {
+        telemetryDropped++;
+        return;
+    }
 
-        for (auto& d : spaceDust) {
-            d.x += d.vx * speedMultiplier;
-            d.y += d.vy * speedMultiplier;
-            if (d.x < -1.2f || d.x > 1.2f || d.y < -1.2f || d.y > 1.2f) {
-                d.x = -1.0f + (rand() % 200) / 100.0f;
-                d.y = -1.0f + (rand() % 200) / 100.0f;
-            }
-        }
+    const FrameState& fs = *frameView;
+    bool newTick = fs.sim.tick != telemetryLastTick;
+    telemetryLastTick = fs.sim.tick;
+
+    TelemetryRecord& r = telemetryQueue[head % TELEMETRY_QUEUE_SIZE];
+    r.frame = telemetryFrames++;
+    r.tick = fs.sim.tick;
+    r.scene = currentFrame;
+    r.bodies = fs.bodyCount;
+    r.particles = fs.dust.count + fs.shootingStars.count + fs.meteors.count + fs.cometTail.count
+                + fs.nbodyPoints.size() / 2 + fs.nbodyAsteroids.size() / 3;
+    r.speed = speedMultiplier;
+    r.simTime = fs.sim.time;
+    r.updateStartUs = newTick ? fs.updateStartUs : -1.0;
+    r.generateStartUs = fs.generateStartUs;
+    r.submitStartUs = submitStartUs;
+    r.swapStartUs = swapStartUs;
+    r.presentUs = presentUs;
+    r.updateMs = newTick ? fs.updateMs : 0.0f;
+    r.generateMs = newTick ? fs.generateMs : 0.0f;
+    r.submitMs = (swapStartUs - submitStartUs) / 1000.0;
+    r.swapMs = (presentUs - swapStartUs) / 1000.0;
+    r.presentMs = presentMs;
+    r.multiView = multiView;
+    for (int t = 0; t < 4; t++) {
+        r.tileStartUs[t] = tileStartUs[t];
+        r.tileMs[t] = multiView ? tileMs[t] : 0.0f;
     }
+    r.tileBudgetMs = frameBudgetMs() / 4.0f;
+    r.inputCount = frameInputCount;
+    copy(frameInputs, frameInputs + frameInputCount, r.inputs);
+    telemetryHead.store(head + 1, memory_order_release);
+}
+
+void display() {
+    beginFrameAllocations();
+    consumeFrameState();
+    applyViewControls();
+    double submitStartUs = telemetryClockUs();
+    static double lastCameraUs = submitStartUs;
+    updateCameras(min((submitStartUs - lastCameraUs) / 1e6, 0.1));
+    lastCameraUs = submitStartUs;
+    renderScene();
+    double swapStartUs = telemetryClockUs();
+    glutSwapBuffers();
+    double presentUs = telemetryClockUs();
+    reportFirstFrame();
+    recordInputLatency(presentUs);
+    recordTelemetry(submitStartUs, swapStartUs, presentUs, recordPresent());
+    updateQualityGovernor(((paceMode == PACE_VSYNC ? swapStartUs : presentUs) - submitStartUs) / 1000.0);
+    endFrameAllocations();
+}
 
-    glutPostRedisplay();
-    glutTimerFunc(16, update, 0);
+void initializeDust(int count) {
+    dustCount = count;
+    initParticlePool(dustPool, count, 1.0f, 0.0f, 1.2f, false, false);
+    for (int i = 0; i < count; i++) {
+        float vx = -0.001f + (simRandom() % 2) / 1000.0f;
+        float vy = -0.001f + (simRandom() % 2) / 1000.0f;
+        float alpha = 0.2f + (simRandom() % 5) / 10.0f;
+        spawnParticle(dustPool, randomRange(-1.2f, 1.2f), randomRange(-1.2f, 1.2f), vx, vy, 0.0f,
+                      0.7f, 0.7f, 0.8f, alpha);
+    }
 }
 
 void initializeObjects() {
-    srand(time(0));
+    srand(sessionSeed);
+    simRandomState = sessionSeed | 1;
     
   
     for (int i = 0; i < 300; i++) {
         Star s;
-        s.x = -1.2f + (rand() % 240) / 100.0f;
-        s.y = -1.2f + (rand() % 240) / 100.0f;
-        s.brightness = 0.3f + (rand() % 70) / 100.0f;
-        s.twinkleSpeed = 0.5f + (rand() % 15) / 10.0f;
+        s.x = -1.2f + (simRandom() % 240) / 100.0f;
+        s.y = -1.2f + (simRandom() % 240) / 100.0f;
+        s.brightness = 0.3f + (simRandom() % 70) / 100.0f;
+        s.twinkleSpeed = 0.5f + (simRandom() % 15) / 10.0f;
         stars.push_back(s);
     }
 
    
     for (int i = 0; i < 150; i++) {
         Asteroid a;
-        a.angle = (rand() % 360) * PI / 180.0f;
-        a.distance = 0.58f + (rand() % 10) / 100.0f;
-        a.size = 0.002f + (rand() % 3) / 1000.0f;
-        a.speed = 0.001f + (rand() % 5) / 10000.0f;
+        a.angle = (simRandom() % 360) * PI / 180.0f;
+        a.distance = 0.58f + (simRandom() % 10) / 100.0f;
+        a.size = 0.002f + (simRandom() % 3) / 1000.0f;
+        a.speed = 0.001f + (simRandom() % 5) / 10000.0f;
         asteroids.push_back(a);
     }
 
    
-    for (int i = 0; i < 100; i++) {
-        SpaceDust d;
-        d.x = -1.0f + (rand() % 200) / 100.0f;
-        d.y = -1.0f + (rand() % 200) / 100.0f;
-        d.vx = -0.001f + (rand() % 2) / 1000.0f;
-        d.vy = -0.001f + (rand() % 2) / 1000.0f;
-        d.size = 1.0f + (rand() % 2) / 10.0f;
-        d.alpha = 0.2f + (rand() % 5) / 10.0f;
-        spaceDust.push_back(d);
+    initializeDust(dustCount);
+
+    initParticlePool(shootingStarPool, 64, 2.5f, 8.0f, 0.0f, true, true);
+    shootingStarEmitter = {0.01f, 0.0f, -0.4f, 0.85f, 0.6f, 0.1f, 0.015f, -0.008f, 0.003f,
+                           45.0f, 10.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+
+    initParticlePool(meteorPool, 64, 2.5f, 12.0f, 0.0f, true, true);
+    meteorEmitter = {0.04f, 0.0f, -0.1f, 0.85f, 0.6f, 0.05f, 0.003f, -0.004f, 0.0005f,
+                     100.0f, 20.0f, 1.0f, 0.9f, 0.6f, 0.8f};
+
+    initParticlePool(cometTailPool, 512, 2.0f, 0.0f, 0.0f, true, false);
+    cometTailEmitter = {3.0f, 0.0f, 0.0f, 0.0f, 0.004f, 0.004f, 0.0f, 0.0f, 0.0008f,
+                        60.0f, 20.0f, 0.6f, 0.8f, 1.0f, 0.35f};
+
+    buildTransformGraph(liveTransforms);
+    frameTransforms = liveTransforms;
+}
+
+void loadReplay(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        cerr << "Cannot open replay file " << path << endl;
+        exit(1);
+    }
+    char magic[16] = {0};
+    int nbody = 0;
+    if (fscanf(file, "%15s %u %d %d %d %lld", magic, &sessionSeed, &replayDust, &replayNBodyCount,
+               &nbody, &replayStartTick) != 6 || strcmp(magic, "SSEREC1") != 0) {
+        cerr << path << " is not a session recording" << endl;
+        exit(1);
+    }
+    replayNBody = nbody != 0;
+    sessionSeedPinned = true;
+
+    char word[32];
+    while (fscanf(file, "%31s", word) == 1) {
+        if (strcmp(word, "end") == 0) {
+            if (fscanf(file, "%lld %llx", &replayEndTick, &replayExpectedChecksum) != 2) break;
+            replaying = true;
+            break;
+        }
+        ReplayEvent r;
+        r.tick = atoll(word);
+        if (fscanf(file, "%d %d %f %f", &r.event.type, &r.event.key, &r.event.x, &r.event.y) != 4) break;
+        r.event.sequence = 0;
+        replayEvents.push_back(r);
+    }
+    fclose(file);
+    if (!replaying) {
+        cerr << path << " is truncated (no end record)" << endl;
+        exit(1);
     }
 }
 
-void keyboard(unsigned char key, int x, int y) {
-   
-    if (key >= '1' && key <= '4') {
-        currentFrame = key - '0';
-        glutPostRedisplay();
+void startRecording(const char* path) {
+    recordFile = fopen(path, "w");
+    if (!recordFile) {
+        cerr << "Cannot open record file " << path << endl;
+        exit(1);
+    }
+}
+
+void warmStartNBody() {
+    if (!sessionSeedPinned) {
+        initializeNBody();
         return;
     }
-    
-    switch (key) {
-        case 'p': case 'P': isPaused = !isPaused; break;
-        case 'h': case 'H': showHelp = !showHelp; break;
-        case '+': case '=': 
-            speedMultiplier = min(speedMultiplier + 0.25f, 2.0f); 
-            break;
-        case '-': case '_': 
-            speedMultiplier = max(speedMultiplier - 0.25f, 0.25f); 
-            break;
-        case 'e': case 'E': eclipseMode = !eclipseMode; break;
-        case 'z': case 'Z': zoomPlanetIndex = -1; break;
-        case '0': case '5': case '6': case '7':
-            
-            if (key >= '0' && key <= '7') {
-                int idx = key - '0';
-                if (idx < 8) planetPaused[idx] = !planetPaused[idx];
-            }
-            break;
-        case 27: 
-            exit(0);
-            break;
+    unsigned long long key = fnvHash(&nbodyParticleCount, sizeof(nbodyParticleCount));
+    key = fnvHash(&simRandomState, sizeof(simRandomState), key);
+    key = fnvHash(&liveSim.angleAll, sizeof(liveSim.angleAll), key);
+    key = fnvHash(&nbodyBeltMass, sizeof(nbodyBeltMass), key);
+    key = fnvHash(asteroids.data(), asteroids.size() * sizeof(Asteroid), key);
+
+    MappedArtifact artifact;
+    size_t bytes = (size_t)nbodyParticleCount * sizeof(NBodyParticle);
+    if (openArtifact(ARTIFACT_NBODY_BELT, key, artifact) && artifact.size == sizeof(simRandomState) + bytes) {
+        memcpy(&simRandomState, artifact.data, sizeof(simRandomState));
+        const NBodyParticle* particles = (const NBodyParticle*)(artifact.data + sizeof(simRandomState));
+        nbodyParticles.assign(particles, particles + nbodyParticleCount);
+        for (int i = 0; i < nbodyParticleCount; i++) {
+            if (nbodyParticles[i].id == 0) nbodyCometSlot = i;
+        }
+        artifactsReused++;
+    } else {
+        seedNBodyBelt();
+        computeNBodyForces(liveSim.angleAll);
+        vector<unsigned char> payload(sizeof(simRandomState) + bytes);
+        memcpy(payload.data(), &simRandomState, sizeof(simRandomState));
+        memcpy(payload.data() + sizeof(simRandomState), nbodyParticles.data(), bytes);
+        storeArtifact(ARTIFACT_NBODY_BELT, key, payload);
+        artifactsRebuilt++;
     }
-    glutPostRedisplay();
+    closeArtifact(artifact);
+    nbodyStepCount = 0;
 }
 
-void specialKeys(int key, int x, int y) {
-    if (currentFrame == 2 && zoomPlanetIndex == -1) {
-        if (key >= GLUT_KEY_F1 && key <= GLUT_KEY_F8) {
-            zoomPlanetIndex = key - GLUT_KEY_F1;
+void startSession() {
+    if (replaying) {
+        nbodyParticleCount = replayNBodyCount;
+        liveControls.nbodyMode = replayNBody;
+        if (liveSim.tick != replayStartTick) seekSimulation(replayStartTick);
+        dustCount = replayDust;
+    }
+    simRandomState = sessionSeed | 1;
+    initializeDust(dustCount);
+    shootingStarPool.count = meteorPool.count = cometTailPool.count = 0;
+    if (liveControls.nbodyMode) warmStartNBody();
+
+    if (recordFile) {
+        fprintf(recordFile, "SSEREC1 %u %d %d %d %lld\n", sessionSeed, dustCount, nbodyParticleCount,
+                liveControls.nbodyMode ? 1 : 0, liveSim.tick);
+    }
+}
+
+bool finishSession() {
+    bool allocationsClean = reportAllocAudit();
+    if (recordFile) {
+        fprintf(recordFile, "end %lld %llx\n", liveSim.tick, simChecksum());
+        fclose(recordFile);
+        recordFile = nullptr;
+        cout << "Session recorded (seed " << sessionSeed << ", " << liveSim.tick << " ticks)" << endl;
+    }
+    if (!replaying) return allocationsClean;
+    if (!replayFinished.load()) {
+        cout << "Replay stopped early at tick " << liveSim.tick << " of " << replayEndTick << endl;
+        return allocationsClean;
+    }
+    bool match = replayChecksum == replayExpectedChecksum;
+    cout << "Replay of " << replayEvents.size() << " events finished at tick " << replayEndTick << ": state "
+         << (match ? "matches" : "DIVERGES FROM") << " the recording" << endl;
+    return match && allocationsClean;
+}
+
+int runHeadlessReplay() {
+    initializeObjects();
+    recordSnapshot();
+    startSession();
+    long long ticks = 0;
+    auto start = chrono::steady_clock::now();
+    while (!replayFinished.load()) {
+        processInputs();
+        if (replayFinished.load()) break;
+        simulationTick();
+        publishFrameState();
+        consumeFrameState();
+        ticks++;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Replayed " << ticks << " ticks in " << fixed << setprecision(3) << seconds << " s ("
+         << seconds * 1000.0 / max(1LL, ticks) << " ms/tick)" << endl;
+    return finishSession() ? 0 : 1;
+}
+
+void reportFramePacing() {
+    if (pacePresented < 2) return;
+    const char* modeNames[] = {"vsync", "target", "uncapped"};
+    cout << "Frame pacing (" << modeNames[paceMode] << "): " << pacePresented << " frames, "
+         << fixed << setprecision(2) << paceMeanMs << " ms mean, " << paceJitterMs << " ms jitter, "
+         << paceWorstMs << " ms worst, " << paceMissed << " missed" << endl;
+    for (int k = 0; k < LATENCY_KINDS; k++) {
+        const LatencyStats& stats = latencyStats[k];
+        if (stats.total == 0) continue;
+        cout << "Input to photon (" << latencyNames[k] << "): " << stats.total << " events, " << stats.p50
+             << " ms p50, " << stats.p95 << " ms p95, " << stats.p99 << " ms p99" << endl;
+    }
+}
+
+void quitApplication() {
+    stopSimulationThread();
+    stopTelemetry();
+    stopStarCatalog();
+    reportFramePacing();
+    exit(finishSession() ? 0 : 1);
+}
+
+void paceFrame() {
+    if (paceMode == PACE_TARGET) {
+        auto period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0 / paceTargetHz));
+        auto now = chrono::steady_clock::now();
+        auto remaining = paceDeadline - now;
+        if (remaining > chrono::milliseconds(2)) {
+            this_thread::sleep_for(min<chrono::steady_clock::duration>(remaining - chrono::milliseconds(1), chrono::milliseconds(4)));
+            return;
         }
+        while (chrono::steady_clock::now() < paceDeadline) this_thread::yield();
+
+        paceDeadline += period;
+        if (chrono::steady_clock::now() - paceDeadline > period) paceDeadline = chrono::steady_clock::now() + period;
     }
-    glutPostRedisplay();
+
+    if (!simThreaded) catchUpSimulation();
+    display();
+    if (replayFinished.load()) quitApplication();
 }
 
-void reshape(int width, int height) {
-    glViewport(0, 0, width, height);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    float aspect = (float)width / (float)height;
-    if (width >= height) {
-        glOrtho(-aspect, aspect, -1.0, 1.0, -1.0, 1.0);
+
+const int EXPORT_PBO_COUNT = 4;
+const int EXPORT_QUEUE_DEPTH = 8;
+
+string exportPath;
+string exportScenes;
+bool exportY4M = false;
+int exportFramesPerScene = 600;
+int exportWidth = 0, exportHeight = 0;
+int exportSceneIndex = 0;
+int exportSceneFrame = 0;
+long long exportSubmitted = 0;
+long long exportWritten = 0;
+long long exportFrameNumber = 0;
+int exportJobs = 1;
+int exportJob = 0;
+bool exportNumbered = false;
+vector<long long> exportBufferFrames;
+GLuint exportPbos[EXPORT_PBO_COUNT];
+bool exportUsePbos = false;
+FILE* exportFile = nullptr;
+chrono::steady_clock::time_point exportStart;
+
+vector<vector<unsigned char>> exportBuffers;
+vector<int> exportFree;
+vector<int> exportReady;
+size_t exportReadyHead = 0;
+bool exportDone = false;
+mutex exportMutex;
+condition_variable exportCondition;
+thread exportWriter;
+
+string numberedPath(const string& path, long long number) {
+    size_t slash = path.find_last_of("/\\");
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) dot = path.size();
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%05lld", number);
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+void writeExportHeader(FILE* file) {
+    if (exportY4M) fprintf(file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", exportWidth, exportHeight);
+}
+
+void writeExportFrame(FILE* file, const unsigned char* rgba, vector<unsigned char>& scratch) {
+    int w = exportWidth, h = exportHeight;
+    if (exportY4M) {
+        scratch.resize(w * h * 3 / 2);
+        unsigned char* yPlane = scratch.data();
+        unsigned char* uPlane = yPlane + w * h;
+        unsigned char* vPlane = uPlane + (w / 2) * (h / 2);
+        for (int y = 0; y < h; y++) {
+            const unsigned char* row = rgba + (h - 1 - y) * w * 4;
+            for (int x = 0; x < w; x++) {
+                int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+                yPlane[y * w + x] = (unsigned char)((77 * r + 150 * g + 29 * b) >> 8);
+            }
+        }
+        for (int y = 0; y < h / 2; y++) {
+            const unsigned char* row0 = rgba + (h - 1 - y * 2) * w * 4;
+            const unsigned char* row1 = row0 - w * 4;
+            for (int x = 0; x < w / 2; x++) {
+                int r = 0, g = 0, b = 0;
+                for (const unsigned char* px : {row0 + x * 8, row0 + x * 8 + 4, row1 + x * 8, row1 + x * 8 + 4}) {
+                    r += px[0];
+                    g += px[1];
+                    b += px[2];
+                }
+                r /= 4;
+                g /= 4;
+                b /= 4;
+                uPlane[y * (w / 2) + x] = (unsigned char)min(255, max(0, 128 + ((-43 * r - 85 * g + 128 * b) >> 8)));
+                vPlane[y * (w / 2) + x] = (unsigned char)min(255, max(0, 128 + ((128 * r - 107 * g - 21 * b) >> 8)));
+            }
+        }
+        fputs("FRAME\n", file);
     } else {
-        glOrtho(-1.0, 1.0, -1.0/aspect, 1.0/aspect, -1.0, 1.0);
+        scratch.resize(w * h * 3);
+        for (int y = 0; y < h; y++) {
+            const unsigned char* row = rgba + (h - 1 - y) * w * 4;
+            unsigned char* out = scratch.data() + y * w * 3;
+            for (int x = 0; x < w; x++) {
+                out[x * 3] = row[x * 4];
+                out[x * 3 + 1] = row[x * 4 + 1];
+                out[x * 3 + 2] = row[x * 4 + 2];
+            }
+        }
+        fprintf(file, "P6\n%d %d\n255\n", w, h);
     }
-    glMatrixMode(GL_MODELVIEW);
+    fwrite(scratch.data(), 1, scratch.size(), file);
+}
+
+void exportWriterLoop() {
+    vector<unsigned char> scratch;
+    while (true) {
+        int index;
+        {
+            unique_lock<mutex> lock(exportMutex);
+            exportCondition.wait(lock, [] { return exportReadyHead < exportReady.size() || exportDone; });
+            if (exportReadyHead == exportReady.size()) break;
+            index = exportReady[exportReadyHead++];
+        }
+        if (exportNumbered) {
+            string path = numberedPath(exportPath, exportBufferFrames[index]);
+            FILE* file = fopen(path.c_str(), "wb");
+            if (!file) {
+                cerr << "Cannot open export output " << path << endl;
+                exit(1);
+            }
+            writeExportHeader(file);
+            writeExportFrame(file, exportBuffers[index].data(), scratch);
+            fclose(file);
+        } else {
+            writeExportFrame(exportFile, exportBuffers[index].data(), scratch);
+        }
+        {
+            lock_guard<mutex> lock(exportMutex);
+            exportFree.push_back(index);
+            exportWritten++;
+        }
+        exportCondition.notify_all();
+    }
+    if (exportFile) fflush(exportFile);
+}
+
+int acquireExportBuffer() {
+    unique_lock<mutex> lock(exportMutex);
+    exportCondition.wait(lock, [] { return !exportFree.empty(); });
+    int index = exportFree.back();
+    exportFree.pop_back();
+    return index;
+}
+
+void queueExportBuffer(int index) {
+    {
+        lock_guard<mutex> lock(exportMutex);
+        if (exportReadyHead == exportReady.size()) {
+            exportReady.clear();
+            exportReadyHead = 0;
+        }
+        exportReady.push_back(index);
+    }
+    exportCondition.notify_all();
+}
+
+void stopExportWriter() {
+    {
+        lock_guard<mutex> lock(exportMutex);
+        exportDone = true;
+    }
+    exportCondition.notify_all();
+    exportWriter.join();
+    if (exportFile && exportFile != stdout) fclose(exportFile);
+}
+
+void collectExportFrame(long long frame) {
+    GLuint pbo = exportPbos[frame % EXPORT_PBO_COUNT];
+    pglBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    void* pixels = pglMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (!pixels) {
+        pglBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        cerr << "Cannot map the export pixel buffer for frame " << frame << ", aborting export" << endl;
+        stopExportWriter();
+        stopTelemetry();
+        stopStarCatalog();
+        exit(1);
+    }
+    int index = acquireExportBuffer();
+    exportBufferFrames[index] = frame;
+    memcpy(exportBuffers[index].data(), pixels, exportBuffers[index].size());
+    pglUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    pglBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    queueExportBuffer(index);
+}
+
+void captureExportFrame(long long frame) {
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    if (!exportUsePbos) {
+        int index = acquireExportBuffer();
+        exportBufferFrames[index] = frame;
+        glReadPixels(0, 0, exportWidth, exportHeight, GL_RGBA, GL_UNSIGNED_BYTE, exportBuffers[index].data());
+        queueExportBuffer(index);
+        exportSubmitted++;
+        return;
+    }
+
+    pglBindBuffer(GL_PIXEL_PACK_BUFFER, exportPbos[exportSubmitted % EXPORT_PBO_COUNT]);
+    glReadPixels(0, 0, exportWidth, exportHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    pglBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    exportSubmitted++;
+
+    long long ready = exportSubmitted - EXPORT_PBO_COUNT;
+    if (ready >= 0) collectExportFrame(ready);
+}
+
+void startExport() {
+    exportWidth = glutGet(GLUT_WINDOW_WIDTH) & ~1;
+    exportHeight = glutGet(GLUT_WINDOW_HEIGHT) & ~1;
+    if (exportScenes.empty()) exportScenes = string(1, (char)('0' + liveControls.currentFrame));
+
+    if (!exportNumbered) {
+        exportFile = exportPath == "-" ? stdout : fopen(exportPath.c_str(), "wb");
+        if (!exportFile) {
+            cerr << "Cannot open export output " << exportPath << endl;
+            exit(1);
+        }
+        writeExportHeader(exportFile);
+    }
+
+    exportBuffers.assign(EXPORT_QUEUE_DEPTH, vector<unsigned char>(exportWidth * exportHeight * 4));
+    exportBufferFrames.assign(EXPORT_QUEUE_DEPTH, 0);
+    for (int i = 0; i < EXPORT_QUEUE_DEPTH; i++) exportFree.push_back(i);
+    exportReady.reserve(EXPORT_QUEUE_DEPTH * 2);
+
+    exportUsePbos = hasPixelBuffers();
+    if (exportUsePbos) {
+        pglGenBuffers(EXPORT_PBO_COUNT, exportPbos);
+        for (int i = 0; i < EXPORT_PBO_COUNT; i++) {
+            pglBindBuffer(GL_PIXEL_PACK_BUFFER, exportPbos[i]);
+            pglBufferData(GL_PIXEL_PACK_BUFFER, exportWidth * exportHeight * 4, nullptr, GL_STREAM_READ);
+        }
+        pglBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    liveControls.currentFrame = exportScenes[0] - '0';
+    showPacingStats = false;
+    exportWriter = thread(exportWriterLoop);
+    exportStart = chrono::steady_clock::now();
+}
+
+void finishExport() {
+    if (exportUsePbos) {
+        // captureExportFrame has already collected everything up to exportSubmitted - EXPORT_PBO_COUNT.
+        for (long long f = max(0LL, exportSubmitted - EXPORT_PBO_COUNT + 1); f < exportSubmitted; f++) {
+            collectExportFrame(f);
+        }
+        pglDeleteBuffers(EXPORT_PBO_COUNT, exportPbos);
+    }
+    stopExportWriter();
+    bool complete = exportWritten == exportSubmitted;
+    if (!complete) cerr << "Export wrote " << exportWritten << " frames but rendered " << exportSubmitted << endl;
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - exportStart).count();
+    if (exportJobs > 1) cerr << "Job " << exportJob + 1 << "/" << exportJobs << ": ";
+    cerr << "Exported " << exportWritten << " frames (" << exportWidth << "x" << exportHeight << ") in "
+         << fixed << setprecision(2) << seconds << " s, " << exportWritten / max(seconds, 1e-6) << " fps" << endl;
+    if (softwareRender && swFlushCount > 0) {
+        cerr << "Software rasterizer: " << swFlushMs / swFlushCount << " ms per frame on " << swThreads << " threads" << endl;
+    }
+    stopTelemetry();
+    stopStarCatalog();
+    exit(finishSession() && complete ? 0 : 1);
+}
+
+void exportIdle() {
+    if (exportSceneFrame == exportFramesPerScene) {
+        exportSceneFrame = 0;
+        exportSceneIndex++;
+        if (exportSceneIndex >= (int)exportScenes.size()) finishExport();
+        liveControls.currentFrame = exportScenes[exportSceneIndex] - '0';
+    }
+
+    // Every job steps the simulation through all frames but renders only every exportJobs-th one.
+    // Its frames are byte-identical to a serial export's, because nothing drawn depends on wall-clock
+    // time or on which earlier frames this process rendered: the pacing HUD and the multiview tile
+    // timings (an average over this job's frames only) are hidden, and rand is reseeded per frame.
+    long long frame = exportFrameNumber++;
+    beginFrameAllocations();
+    processInputs();
+    simulationTick();
+    publishFrameState();
+    consumeFrameState();
+    applyViewControls();
+    updateCameras(1.0f / 60.0f);
+    if (frame % exportJobs == exportJob) {
+        srand(sessionSeed + (unsigned int)frame);
+        double submitStartUs = telemetryClockUs();
+        renderScene();
+        captureExportFrame(frame);
+        double swapStartUs = telemetryClockUs();
+        glutSwapBuffers();
+        double presentUs = telemetryClockUs();
+        reportFirstFrame();
+        recordTelemetry(submitStartUs, swapStartUs, presentUs, recordPresent());
+    }
+    endFrameAllocations();
+    exportSceneFrame++;
+    if (replayFinished.load()) finishExport();
+}
+
+void forkExportJobs() {
+#if defined(__unix__) || defined(__APPLE__)
+    fflush(nullptr);
+    auto start = chrono::steady_clock::now();
+    vector<pid_t> children;
+    for (int job = 0; job < exportJobs; job++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            cerr << "Cannot start export job " << job + 1 << endl;
+            for (pid_t child : children) kill(child, SIGTERM);
+            exit(1);
+        }
+        if (pid == 0) {
+            // Threads do not survive fork, so the child grows its own rasterizer workers.
+            exportJob = job;
+            workerPool = nullptr;
+            if (job > 0) {
+                cout.setstate(ios::failbit);
+                if (recordFile) fclose(recordFile);
+                recordFile = nullptr;
+                if (!telemetryPath.empty()) telemetryPath = numberedPath(telemetryPath, job);
+            }
+            return;
+        }
+        children.push_back(pid);
+    }
+
+    if (recordFile) fclose(recordFile);
+    bool ok = true;
+    for (pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "Export finished on " << exportJobs << " jobs in " << fixed << setprecision(2) << seconds << " s" << endl;
+    exit(ok ? 0 : 1);
+#else
+    cerr << "--export-jobs needs fork(); rendering all frames in one process" << endl;
+    exportJobs = 1;
+#endif
+}
+
+void keyboard(unsigned char key, int x, int y) {
+    if (key == 27) quitApplication();
+    pushInput(INPUT_KEY, key, x, y);
+}
+
+void specialKeys(int key, int x, int y) {
+    pushInput(INPUT_SPECIAL, key, x, y);
+}
+
+void mouse(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) return;
+    float width = glutGet(GLUT_WINDOW_WIDTH);
+    float height = glutGet(GLUT_WINDOW_HEIGHT);
+    float aspect = width / height;
+    float wx = 2.0f * x / width - 1.0f;
+    float wy = 1.0f - 2.0f * y / height;
+    if (width >= height) wx *= aspect;
+    else wy /= aspect;
+    if (currentFrame == 1 && !multiView) {
+        wx = cameras[1].x + wx / cameras[1].zoom;
+        wy = cameras[1].y + wy / cameras[1].zoom;
+    }
+    pushInput(INPUT_MOUSE, button, wx, wy);
+}
+
+void reshape(int width, int height) {
+    windowWidth = width;
+    windowHeight = max(1, height);
+    glViewport(0, 0, width, windowHeight);
+    setProjection(width, windowHeight);
 }
 
 int main(int argc, char** argv) {
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
-    glutInitWindowSize(SCR_WIDTH, SCR_HEIGHT);
-    glutInitWindowPosition(100, 100);
-    glutCreateWindow("Solar System Explorer - Legacy OpenGL");
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--make-catalog" && i + 2 < argc) {
+            makeStarCatalog(argv[i + 1], max(1LL, atoll(argv[i + 2])));
+            return 0;
+        }
+        if (string(argv[i]) == "--eclipse-report" && i + 1 < argc) {
+            double span = max(1.0, atof(argv[++i])) * 360.0 / speeds[2];
+            vector<EclipseEvent> events;
+            auto start = chrono::steady_clock::now();
+            searchEclipses(liveSim.angleAll, liveSim.angleAll + span, events);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            int counts[3] = {0, 0, 0};
+            for (auto& e : events) counts[e.kind]++;
+            cout << "Found " << events.size() << " events (" << counts[EVENT_MOON_ECLIPSE] << " moon eclipses, "
+                 << counts[EVENT_SHADOW_TRANSIT] << " shadow transits, " << counts[EVENT_SUN_TRANSIT]
+                 << " solar transits) over " << argv[i] << " Earth orbits in " << fixed << setprecision(2) << ms << " ms" << endl;
+            for (size_t k = 0; k < min(events.size(), (size_t)10); k++) {
+                char what[96];
+                describeEclipse(events[k], what);
+                cout << "  angle " << events[k].start << " - " << events[k].end << "  " << what << endl;
+            }
+            return 0;
+        }
+        if (string(argv[i]) == "--seed" && i + 1 < argc) {
+            sessionSeed = strtoul(argv[++i], nullptr, 10);
+            sessionSeedPinned = true;
+        } else if (string(argv[i]) == "--replay" && i + 1 < argc) {
+            loadReplay(argv[++i]);
+        } else if ((string(argv[i]) == "--cache-dir" || string(argv[i]) == "--texture-cache") && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (string(argv[i]) == "--no-cache") {
+            cacheEnabled = false;
+        } else if (string(argv[i]) == "--cache-limit" && i + 1 < argc) {
+            cacheLimitBytes = (unsigned long long)max(1LL, atoll(argv[++i])) << 20;
+        } else if (string(argv[i]) == "--alloc-audit") {
+            allocAudit = true;
+        } else if (string(argv[i]) == "--software") {
+            softwareRender = true;
+        } else if (string(argv[i]) == "--software-threads" && i + 1 < argc) {
+            swThreads = max(1, atoi(argv[++i]));
+            swThreadsPinned = true;
+        } else if (string(argv[i]) == "--size" && i + 1 < argc) {
+            int width = 0, height = 0;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                windowWidth = width;
+                windowHeight = height;
+            }
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        if (replaying && string(argv[i]) == "--headless") return runHeadlessReplay();
+    }
+
+    if (softwareRender) {
+        swInitialize(windowWidth, windowHeight);
+    } else {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+        glutInitWindowSize(windowWidth, windowHeight);
+        glutInitWindowPosition(100, 100);
+        glutCreateWindow("Solar System Explorer - Legacy OpenGL");
+    }
 
     
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -1707,26 +6789,172 @@ int main(int argc, char** argv) {
     glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
     glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
 
+    if (!softwareRender) loadGLExtensions();
     initializeObjects();
+    recordSnapshot();
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--particles" && i + 1 < argc) {
+            initializeDust(max(0, atoi(argv[++i])));
+        } else if (arg == "--seek" && i + 1 < argc) {
+            seekSimulation(atoll(argv[++i]));
+        } else if (arg == "--nbody" && i + 1 < argc) {
+            nbodyParticleCount = max(2, atoi(argv[++i]));
+            liveControls.nbodyMode = true;
+        } else if (arg == "--export" && i + 1 < argc) {
+            exportPath = argv[++i];
+            exportY4M = exportPath.size() > 4 && exportPath.substr(exportPath.size() - 4) == ".y4m";
+        } else if (arg == "--export-format" && i + 1 < argc) {
+            exportY4M = string(argv[++i]) == "y4m";
+        } else if (arg == "--export-frames" && i + 1 < argc) {
+            exportFramesPerScene = max(1, atoi(argv[++i]));
+        } else if (arg == "--export-jobs" && i + 1 < argc) {
+            exportJobs = max(1, atoi(argv[++i]));
+            exportNumbered = exportJobs > 1;
+        } else if (arg == "--single-thread") {
+            simThreaded = false;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            paceTargetHz = max(1.0, atof(argv[++i]));
+            paceMode = PACE_TARGET;
+        } else if (arg == "--vsync") {
+            paceMode = PACE_VSYNC;
+        } else if (arg == "--uncapped") {
+            paceMode = PACE_UNCAPPED;
+        } else if (arg == "--multiview") {
+            liveControls.multiView = true;
+        } else if (arg == "--telemetry" && i + 1 < argc) {
+            telemetryPath = argv[++i];
+            telemetryCSV = telemetryPath.size() > 4 && telemetryPath.substr(telemetryPath.size() - 4) == ".csv";
+        } else if (arg == "--telemetry-format" && i + 1 < argc) {
+            telemetryCSV = string(argv[++i]) == "csv";
+        } else if (arg == "--quality" && i + 1 < argc) {
+            string mode = argv[++i];
+            qualityAuto = mode == "auto";
+            if (!qualityAuto) applyQualityTier(min(max(atoi(mode.c_str()), 0), QUALITY_TIER_COUNT - 1));
+        } else if (arg == "--quality-budget" && i + 1 < argc) {
+            qualityBudgetMs = max(0.0, atof(argv[++i]));
+        } else if (arg == "--trail-length" && i + 1 < argc) {
+            trailLength = max(2, atoi(argv[++i]));
+        } else if (arg == "--trail-decimation" && i + 1 < argc) {
+            trailDecimation = max(1, atoi(argv[++i]));
+        } else if (arg == "--trail-bodies" && i + 1 < argc) {
+            trailBodyLimit = max(0, atoi(argv[++i]));
+        } else if (arg == "--catalog" && i + 1 < argc) {
+            if (!openStarCatalog(argv[++i])) exit(1);
+        } else if (arg == "--catalog-budget" && i + 1 < argc) {
+            catalogStarBudget = max(1, atoi(argv[++i]));
+        } else if (arg == "--no-shaders") {
+            useShaders = false;
+        } else if (arg == "--flat-planets") {
+            planetTextures = false;
+        } else if (arg == "--record" && i + 1 < argc) {
+            startRecording(argv[++i]);
+        } else if (arg == "--export-scenes" && i + 1 < argc) {
+            for (const char* c = argv[++i]; *c; c++) {
+                if (*c >= '1' && *c <= '4') exportScenes += *c;
+            }
+        }
+    }
 
-    glutDisplayFunc(display);
-    glutReshapeFunc(reshape);
-    glutKeyboardFunc(keyboard);
-    glutSpecialFunc(specialKeys);
-    glutTimerFunc(0, update, 0);
-
-    cout << "=== SOLAR SYSTEM EXPLORER - LEGACY OPENGL ===" << endl;
-    cout << "Controls:" << endl;
-    cout << "  1-4: Switch between frames" << endl;
-    cout << "  P: Pause/Resume animation" << endl;
-    cout << "  H: Toggle help overlay" << endl;
-    cout << "  +/-: Increase/Decrease speed" << endl;
-    cout << "  E: Toggle eclipse mode" << endl;
-    cout << "  0-7: Toggle individual planet pause" << endl;
-    cout << "  Z: Exit zoom mode (Frame 2)" << endl;
-    cout << "  ESC: Exit application" << endl;
-    cout << "==============================================" << endl;
+    if (softwareRender && exportPath.empty()) {
+        cerr << "--software renders offline and needs --export" << endl;
+        return 1;
+    }
+    if (exportNumbered && (!softwareRender || exportPath == "-" || !catalogPath.empty())) {
+        cerr << "--export-jobs needs --software, an output file name and no --catalog" << endl;
+        return 1;
+    }
+    if (exportJobs > 1 && !swThreadsPinned) swThreads = max(1, swThreads / exportJobs);
+    if (softwareRender) {
+        reshape(swWidth, swHeight);
+    } else {
+        glutDisplayFunc(display);
+        glutReshapeFunc(reshape);
+        glutKeyboardFunc(keyboard);
+        glutSpecialFunc(specialKeys);
+        glutMouseFunc(mouse);
+    }
+    startSession();
+    if (planetTextures) loadPlanetTextures();
+    initNightScene();
+    initPlanetShader();
+    if (exportJobs > 1) forkExportJobs();
+    if (!telemetryPath.empty()) startTelemetry();
+    if (exportPath.empty()) {
+        publishFrameState();
+        if (simThreaded) startSimulationThread();
+        paceLastSimStep = chrono::steady_clock::now();
+        setPaceMode(paceMode);
+        glutIdleFunc(paceFrame);
+    } else {
+        setPaceMode(PACE_UNCAPPED);
+        startExport();
+        if (!softwareRender) glutIdleFunc(exportIdle);
+    }
 
+    ostream& out = exportPath == "-" ? cerr : cout;
+    out << "=== SOLAR SYSTEM EXPLORER - LEGACY OPENGL ===" << endl;
+    out << "Controls:" << endl;
+    out << "  1-4: Switch between frames" << endl;
+    out << "  P: Pause/Resume animation" << endl;
+    out << "  H: Toggle help overlay" << endl;
+    out << "  +/-: Increase/Decrease speed" << endl;
+    out << "  , / .: Decrease/Increase time warp by 10x (up to 1000000x, off in N-body mode)" << endl;
+    out << "  E: Toggle eclipse mode" << endl;
+    out << "  0-7: Toggle individual planet pause" << endl;
+    out << "  Z: Exit zoom mode and release the camera" << endl;
+    out << "  N: Toggle N-body gravity for belt and comet" << endl;
+    out << "  I: Toggle leapfrog / symplectic Euler integrator" << endl;
+    out << "  [ / ]: Rewind / skip ahead 5 seconds" << endl;
+    out << "  Left click: Select a body (planets open their zoom view)" << endl;
+    out << "  V: Cycle frame pacing between vsync, target rate and uncapped" << endl;
+    out << "  Q: Cycle effect quality between adaptive and fixed tiers" << endl;
+    out << "  T: Toggle orbit trails" << endl;
+    out << "  M: Toggle the tiled four-scene multi-view" << endl;
+    out << "  --seek <ticks>: Jump straight to simulation tick <ticks>" << endl;
+    out << "  --nbody <count>: Start in N-body mode with <count> particles" << endl;
+    out << "  --particles <count>: Size of the space dust particle pool" << endl;
+    out << "  --single-thread: Run the simulation on the render thread" << endl;
+    out << "  --fps <hz>: Pace presents to <hz> on the steady clock (default 60)" << endl;
+    out << "  --vsync: Pace presents with swap interval 1" << endl;
+    out << "  --uncapped: Present as fast as possible" << endl;
+    out << "  --multiview: Start with all four scenes tiled" << endl;
+    out << "  --no-shaders: Use the immediate-mode fallbacks instead of GLSL shaders" << endl;
+    out << "  --flat-planets: Draw planets with the original flat primitives instead of textures" << endl;
+    out << "  --cache-dir <dir>: Where generated textures and geometry are cached (default artifact_cache)" << endl;
+    out << "  --no-cache: Regenerate every artifact and leave the cache untouched" << endl;
+    out << "  --cache-limit <MB>: Evict the least recently used artifacts above this size (default 256)" << endl;
+    out << "  --alloc-audit: Report heap allocations in steady-state frames and fail on exit if any occur" << endl;
+    out << "  --seed <n>: Seed the simulation random stream" << endl;
+    out << "  --record <file>: Log the seed and tick-stamped input events of this session" << endl;
+    out << "  --replay <file>: Play a recorded session back and check the final state" << endl;
+    out << "  --headless: With --replay, run the simulation without a window and exit" << endl;
+    out << "  --telemetry <file>: Stream per-frame timings as Chrome trace JSON (or CSV for .csv)" << endl;
+    out << "  --telemetry-format <json|csv>: Override the format implied by the file name" << endl;
+    out << "  --eclipse-report <orbits>: List eclipses and transits over <orbits> Earth years and exit" << endl;
+    out << "  --quality <auto|0-3>: Adaptive effect quality or a fixed tier (3 = full)" << endl;
+    out << "  --quality-budget <ms>: Frame time the adaptive quality aims for (default: the pacing deadline)" << endl;
+    out << "  --trail-length <n>: Samples kept per orbit trail (default 128)" << endl;
+    out << "  --trail-decimation <n>: Ticks between trail samples (default 4)" << endl;
+    out << "  --trail-bodies <n>: Maximum number of bodies with trails (default 4096)" << endl;
+    out << "  --catalog <file>: Stream background stars from a tiled star catalog" << endl;
+    out << "  --catalog-budget <n>: Stars drawn per view; sets the magnitude cutoff (default 4000)" << endl;
+    out << "  --make-catalog <file> <count>: Generate a synthetic catalog and exit" << endl;
+    out << "  --export <file|->: Render frames offline to a PPM stream or .y4m video" << endl;
+    out << "  --export-frames <n>: Frames rendered per scene (default 600)" << endl;
+    out << "  --export-scenes <list>: Scenes to export in order, e.g. 1234" << endl;
+    out << "  --export-format <ppm|y4m>: Override the format implied by the file name" << endl;
+    out << "  --export-jobs <n>: Split a --software export over <n> processes, one numbered file per frame" << endl;
+    out << "  --software: Render the export with the CPU rasterizer, without a window or GL" << endl;
+    out << "  --software-threads <n>: Rasterizer worker threads (default: all cores)" << endl;
+    out << "  --size <w>x<h>: Window or software framebuffer size (default 1200x900)" << endl;
+    out << "  ESC: Exit application" << endl;
+    out << "==============================================" << endl;
+
+    if (softwareRender) {
+        for (;;) exportIdle();
+    }
     glutMainLoop();
     return 0;
 }